@@ -9,9 +9,13 @@ extern Renderer* g_theRenderer;
 
 std::vector<BlockDefintion> BlockDefintion::s_definitions = {};
 std::vector<AABB2> BlockDefintion::s_digCrackUVs = {};
+std::vector<uint16_t> BlockDefintion::s_digCrackSpriteIndices = {};
+std::vector<AABB2> BlockDefintion::s_spriteUVs = {};
+IntVec2 BlockDefintion::s_spriteSheetDimensions = IntVec2(64, 64);
 Texture* BlockDefintion::s_blockSpriteTexture = nullptr;
 
 std::vector<BlockTemplate> BlockTemplate::s_templates = {};
+std::vector<BlockModel> BlockModel::s_models = {};
 
 const BlockDefintion& BlockDefintion::GetDefinitionByName(const std::string& name)
 {
@@ -43,14 +47,21 @@ void BlockDefintion::CreateAllDefintions()
 {
 	s_definitions.reserve(8);
 	s_blockSpriteTexture = g_theRenderer->CreateOrGetTextureFromFile("Data/Images/BasicSprites_64x64.png");
-	SpriteSheet spriteSheet = SpriteSheet(*s_blockSpriteTexture, IntVec2(64, 64));
+	SpriteSheet spriteSheet = SpriteSheet(*s_blockSpriteTexture, s_spriteSheetDimensions);
+	int numSprites = s_spriteSheetDimensions.x * s_spriteSheetDimensions.y;
+	s_spriteUVs.reserve(numSprites);
+	for (int i = 0; i < numSprites; i++)
+	{
+		s_spriteUVs.push_back(spriteSheet.GetSpriteDefinition(i).GetUVs());
+	}
+
 	CreateDefinition("air", false, false, false, 0, spriteSheet, IntVec2::ZERO, IntVec2::ZERO, IntVec2::ZERO);
 	CreateDefinition("grass", true, true, true, 0, spriteSheet, IntVec2(32, 33), IntVec2(32, 34), IntVec2(33, 33));
 	CreateDefinition("dirt", true, true, true, 0, spriteSheet, IntVec2(32, 34), IntVec2(32, 34), IntVec2(32, 34));
 	CreateDefinition("stone", true, true, true, 0, spriteSheet, IntVec2(33, 32), IntVec2(33, 32), IntVec2(33, 32));
 	CreateDefinition("brick", true, true, true, 0, spriteSheet, IntVec2(34, 32), IntVec2(34, 32), IntVec2(34, 32));
 	CreateDefinition("glowstone", true, true, true, 15, spriteSheet, IntVec2(46, 34), IntVec2(46, 34), IntVec2(46, 34));
-	CreateDefinition("water", true, false, false, 0, spriteSheet, IntVec2(32, 44), IntVec2(32, 44), IntVec2(32, 44));
+	CreateDefinition("water", true, false, false, 0, spriteSheet, IntVec2(32, 44), IntVec2(32, 44), IntVec2(32, 44), BLOCK_SHAPE_FLUID);
 	CreateDefinition("coal", true, true, true, 0, spriteSheet, IntVec2(63, 34), IntVec2(63, 34), IntVec2(63, 34));
 	CreateDefinition("cobblestone", true, true, true, 0, spriteSheet, IntVec2(63, 34), IntVec2(63, 34), IntVec2(63, 34));
 	CreateDefinition("iron", true, true, true, 0, spriteSheet, IntVec2(63, 35), IntVec2(63, 35), IntVec2(63, 35));
@@ -62,29 +73,44 @@ void BlockDefintion::CreateAllDefintions()
 	CreateDefinition("leaves", true, true, true, 0, spriteSheet, IntVec2(32, 35), IntVec2(32, 35), IntVec2(32, 35));
 	CreateDefinition("snowgrass", true, true, true, 0, spriteSheet, IntVec2(36, 35), IntVec2(32, 34), IntVec2(33, 35));
 	CreateDefinition("cloud", true, true, true, 0, spriteSheet, IntVec2(0, 4), IntVec2(0, 4), IntVec2(0, 4));
+	CreateDefinition("stone slab", true, true, false, 0, spriteSheet, IntVec2(33, 32), IntVec2(33, 32), IntVec2(33, 32), BLOCK_SHAPE_SLAB);
+	CreateDefinition("tall grass", true, false, false, 0, spriteSheet, IntVec2(32, 35), IntVec2(32, 35), IntVec2(32, 35), BLOCK_SHAPE_CROSS);
+	CreateDefinition("fence post", true, true, false, 0, spriteSheet, IntVec2(38, 33), IntVec2(38, 33), IntVec2(38, 33), BLOCK_SHAPE_MODEL, "fence post");
 
 	IntVec2 crackBaseCoords = IntVec2(32, 46);
 	for (int i = 0; i < 6; i++)
 	{
 		IntVec2 crackCoords = crackBaseCoords + IntVec2(i, 0);
-		int index = crackCoords.x + (64 * crackCoords.y);
+		int index = crackCoords.x + (s_spriteSheetDimensions.x * crackCoords.y);
 		s_digCrackUVs.push_back(spriteSheet.GetSpriteDefinition(index).GetUVs());
+		s_digCrackSpriteIndices.push_back(static_cast<uint16_t>(index));
 	}
 }
 
-void BlockDefintion::CreateDefinition(const std::string& name, bool isVisible, bool isSolid, bool isOpaque, uint8_t indoorLightInfluence, const SpriteSheet& blockTextureSheet, const IntVec2& topfaceSpriteCoords, const IntVec2& botfaceSpriteCoords, const IntVec2& sidefaceSpriteCoords)
+void BlockDefintion::CreateDefinition(const std::string& name, bool isVisible, bool isSolid, bool isOpaque, uint8_t indoorLightInfluence, const SpriteSheet& blockTextureSheet, const IntVec2& topfaceSpriteCoords, const IntVec2& botfaceSpriteCoords, const IntVec2& sidefaceSpriteCoords,
+	BlockShape shape, const std::string& modelName)
 {
 	BlockDefintion def = {name, isVisible, isSolid, isOpaque, indoorLightInfluence};
+	//only full cubes cover their neighbours' faces
+	GUARANTEE_OR_DIE(!isOpaque || shape == BLOCK_SHAPE_CUBE, "Only cube shaped blocks can be opaque");
+	def.m_shape = shape;
+	if (shape == BLOCK_SHAPE_MODEL)
+	{
+		def.m_modelIndex = BlockModel::GetModelIndexFromName(modelName);
+	}
 
 	bool useWhiteBlocks = g_gameConfigBlackboard.GetValue("debugUseWhiteBlocks", false);
 	if (!useWhiteBlocks)
 	{
 		int topfaceSpriteIndex = topfaceSpriteCoords.x + (blockTextureSheet.GetSize().x * topfaceSpriteCoords.y);
 		def.m_topUVs = blockTextureSheet.GetSpriteDefinition(topfaceSpriteIndex).GetUVs();
+		def.m_topSpriteIndex = static_cast<uint16_t>(topfaceSpriteIndex);
 		int botfaceSpriteIndex = botfaceSpriteCoords.x + (blockTextureSheet.GetSize().x * botfaceSpriteCoords.y);
 		def.m_bottomUVs = blockTextureSheet.GetSpriteDefinition(botfaceSpriteIndex).GetUVs();
+		def.m_bottomSpriteIndex = static_cast<uint16_t>(botfaceSpriteIndex);
 		int sidefaceSpriteIndex = sidefaceSpriteCoords.x + (blockTextureSheet.GetSize().x * sidefaceSpriteCoords.y);
 		def.m_sideUVs = blockTextureSheet.GetSpriteDefinition(sidefaceSpriteIndex).GetUVs();
+		def.m_sideSpriteIndex = static_cast<uint16_t>(sidefaceSpriteIndex);
 	}
 	else
 	{ 
@@ -93,6 +119,9 @@ void BlockDefintion::CreateDefinition(const std::string& name, bool isVisible, b
 		def.m_topUVs = blockTextureSheet.GetSpriteDefinition(whiteBlockSpriteIndex).GetUVs();
 		def.m_bottomUVs = blockTextureSheet.GetSpriteDefinition(whiteBlockSpriteIndex).GetUVs();
 		def.m_sideUVs = blockTextureSheet.GetSpriteDefinition(whiteBlockSpriteIndex).GetUVs();
+		def.m_topSpriteIndex = static_cast<uint16_t>(whiteBlockSpriteIndex);
+		def.m_bottomSpriteIndex = static_cast<uint16_t>(whiteBlockSpriteIndex);
+		def.m_sideSpriteIndex = static_cast<uint16_t>(whiteBlockSpriteIndex);
 	}
 	s_definitions.push_back(def);
 }
@@ -107,32 +136,6 @@ bool BlockDefintion::DoesBlockTypeEmitLight(int blockDefIndex)
 	return s_definitions[blockDefIndex].m_indoorLightInfluence > 0;
 }
 
-bool Block::IsBlockSky() const
-{
-	return ((m_bitflags & BLOCK_BIT_IS_SKY) == BLOCK_BIT_IS_SKY);
-}
-
-void Block::SetIsBlockSky(bool isSky)
-{
-	if (isSky)
-		m_bitflags |= BLOCK_BIT_IS_SKY;
-	else
-		m_bitflags &= ~BLOCK_BIT_IS_SKY;
-}
-
-bool Block::IsBlockLightDirty() const
-{
-	return ((m_bitflags & BLOCK_BIT_IS_LIGHT_DIRTY) == BLOCK_BIT_IS_LIGHT_DIRTY);
-}
-
-void Block::SetIsBlockLightDirty(bool isLightDirty)
-{
-	if (isLightDirty)
-		m_bitflags |= BLOCK_BIT_IS_LIGHT_DIRTY;
-	else
-		m_bitflags &= ~BLOCK_BIT_IS_LIGHT_DIRTY;
-}
-
 uint8_t Block::GetIndoorLightInfluence() const
 {
 	return (m_lightInfluence & 0x0f);
@@ -155,22 +158,22 @@ void Block::SetOutdoorLightInfluence(int lightInfluence)
 	m_lightInfluence |= (lightInfluence << 4);	//set the higher 4 bits with the light influence value
 }
 
-bool Block::IsBlockWater() const
+uint8_t Block::GetLightInfluence(LightChannel channel) const
 {
-	return m_typeIndex == BlockDefintion::GetDefinitionIndexByName("water");
+	return channel == LIGHT_CHANNEL_OUTDOOR ? GetOutdoorLightInfluence() : GetIndoorLightInfluence();
 }
 
-uint8_t Block::GetCurrentDugState() const
+void Block::SetLightInfluence(LightChannel channel, int lightInfluence)
 {
-	return m_bitflags >> 2;
+	if (channel == LIGHT_CHANNEL_OUTDOOR)
+		SetOutdoorLightInfluence(lightInfluence);
+	else
+		SetIndoorLightInfluence(lightInfluence);
 }
 
-void Block::IncrementDugState()
+bool Block::IsBlockWater() const
 {
-	uint8_t currentState = GetCurrentDugState();
-	currentState++;
-	m_bitflags &= BLOCK_BIT_CLEAR_CURRENT_DIG_STATE;	//clear dig state
-	m_bitflags |= (currentState << 2);					//set the new dig state value
+	return m_typeIndex == BlockDefintion::GetDefinitionIndexByName("water");
 }
 
 bool BlockTemplate::LoadFromXmlElement(const XmlElement& element)
@@ -219,3 +222,52 @@ BlockTemplate BlockTemplate::GetTemplateFromName(const std::string& name)
 	message.append(name);
 	ERROR_AND_DIE(message);
 }
+
+bool BlockModel::LoadFromXmlElement(const XmlElement& element)
+{
+	m_name = ParseXmlAttribute(element, "name", m_name);
+
+	const XmlElement* boxElement = element.FirstChildElement("Box");
+	while (boxElement)
+	{
+		BlockModelBox box;
+		box.m_mins = ParseXmlAttribute(*boxElement, "mins", box.m_mins);
+		box.m_maxs = ParseXmlAttribute(*boxElement, "maxs", box.m_maxs);
+		GUARANTEE_OR_DIE(box.m_mins.x >= 0 && box.m_mins.y >= 0 && box.m_mins.z >= 0 && box.m_maxs.x <= BLOCK_MODEL_UNITS && box.m_maxs.y <= BLOCK_MODEL_UNITS && box.m_maxs.z <= BLOCK_MODEL_UNITS,
+			"Block model box has to fit inside one block");
+		m_boxes.push_back(box);
+		boxElement = boxElement->NextSiblingElement();
+	}
+
+	return true;
+}
+
+void BlockModel::InitializeModels(const char* path)
+{
+	tinyxml2::XMLDocument doc;
+	tinyxml2::XMLError status = doc.LoadFile(path);
+	GUARANTEE_OR_DIE(status == tinyxml2::XML_SUCCESS, "Failed to load block models data file");
+	tinyxml2::XMLElement* rootElement = doc.RootElement();
+	tinyxml2::XMLElement* childElement = rootElement->FirstChildElement();
+
+	while (childElement)
+	{
+		BlockModel blockModel;
+		blockModel.LoadFromXmlElement(*childElement);
+		BlockModel::s_models.push_back(blockModel);
+		childElement = childElement->NextSiblingElement();
+	}
+}
+
+int BlockModel::GetModelIndexFromName(const std::string& name)
+{
+	for (int i = 0; i < s_models.size(); i++)
+	{
+		if (s_models[i].m_name == name)
+			return i;
+	}
+
+	std::string message = "Invalid block model name ";
+	message.append(name);
+	ERROR_AND_DIE(message);
+}
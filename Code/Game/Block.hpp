@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
+#include "Engine/Math/IntVec2.hpp"
 #include "Engine/Math/IntVec3.hpp"
 #include "Engine/Math/AABB2.hpp"
 #include "Engine/Core/EngineCommon.hpp"
@@ -9,29 +10,56 @@
 class Texture;
 class SpriteSheet;
 
-constexpr uint8_t BLOCK_BIT_IS_SKY = 0x01;
-constexpr uint8_t BLOCK_BIT_IS_LIGHT_DIRTY = 0x02;
-constexpr uint8_t BLOCK_BIT_CLEAR_CURRENT_DIG_STATE = 0b11100011;
+//how a block type is meshed, every shape has its own mesh kernel in ChunkMesher
+enum BlockShape : uint8_t
+{
+	BLOCK_SHAPE_CUBE,		//full block, faces are hidden by opaque neighbours
+	BLOCK_SHAPE_FLUID,		//translucent block, faces are also hidden by other fluid
+	BLOCK_SHAPE_CROSS,		//two quads through the block's diagonals, seen from both sides, for plants
+	BLOCK_SHAPE_SLAB,		//bottom half of a block
+	BLOCK_SHAPE_MODEL,		//boxes of a BlockModel
+	NUM_BLOCK_SHAPES
+};
+
+//the two light channels a block carries, propagated separately
+enum LightChannel : uint8_t
+{
+	LIGHT_CHANNEL_OUTDOOR,		//sky light, the higher 4 bits of m_lightInfluence
+	LIGHT_CHANNEL_INDOOR,		//light of emitting blocks, the lower 4 bits
+	NUM_LIGHT_CHANNELS
+};
+
+//sub block geometry is in sixteenths of a block
+constexpr int BLOCK_MODEL_UNITS = 16;
 
 struct Block
 {
 public:
 	uint8_t m_typeIndex = 0;
 	uint8_t m_lightInfluence = 0; //higher 4 bits are outdoor lighting influence (max 15), lower 4 bits are indoor lighting influence (max 15)
-	uint8_t m_bitflags = 0; // [111(unused)111(digstate)1(light state)1(sky state)]
+	//whether a block sees the sky follows from its chunk's column heights and dirty light is tracked by the chunk's light queue, so neither is stored here
 
 public:
-	bool IsBlockSky() const;
-	void SetIsBlockSky(bool isSky);
-	bool IsBlockLightDirty() const;
-	void SetIsBlockLightDirty(bool isLightDirty);
 	uint8_t GetIndoorLightInfluence() const;
 	void SetIndoorLightInfluence(int lightInfluence);
 	uint8_t GetOutdoorLightInfluence() const;
 	void SetOutdoorLightInfluence(int lightInfluence);
+	uint8_t GetLightInfluence(LightChannel channel) const;
+	void SetLightInfluence(LightChannel channel, int lightInfluence);
 	bool IsBlockWater() const;
-	uint8_t GetCurrentDugState() const;
-	void IncrementDugState();
+};
+static_assert(sizeof(Block) == 2, "Blocks are two bytes, anything else per block goes into BlockMetadata or the chunk");
+
+//transient or rare per block state, kept in a sparse per chunk table instead of in every block
+struct BlockMetadata
+{
+public:
+	uint8_t m_digState = 0;
+	uint8_t m_orientation = 0;
+	uint8_t m_fluidLevel = 0;
+
+public:
+	bool IsEmpty() const { return m_digState == 0 && m_orientation == 0 && m_fluidLevel == 0; }
 };
 
 class BlockDefintion
@@ -45,19 +73,28 @@ public:
 	AABB2 m_topUVs = AABB2::ZERO_TO_ONE;
 	AABB2 m_bottomUVs = AABB2::ZERO_TO_ONE;
 	AABB2 m_sideUVs = AABB2::ZERO_TO_ONE;
+	uint16_t m_topSpriteIndex = 0;
+	uint16_t m_bottomSpriteIndex = 0;
+	uint16_t m_sideSpriteIndex = 0;
+	BlockShape m_shape = BLOCK_SHAPE_CUBE;
+	int m_modelIndex = -1;		//into BlockModel::s_models for BLOCK_SHAPE_MODEL
 
 	static Texture* s_blockSpriteTexture;
 	static std::vector<BlockDefintion> s_definitions;
 	static std::vector<AABB2> s_digCrackUVs;
+	static std::vector<uint16_t> s_digCrackSpriteIndices;
+	static std::vector<AABB2> s_spriteUVs;		//uvs of every sprite in the block sheet, by sprite index
+	static IntVec2 s_spriteSheetDimensions;
 
 public:
 	static const BlockDefintion& GetDefinitionByName(const std::string& name);
 	static uint8_t GetDefinitionIndexByName(const std::string& name);
 	static void CreateAllDefintions();
 	static void CreateDefinition(const std::string& name, bool isVisible, bool isSolid, bool isOpaque, uint8_t indoorLightInfluence, const SpriteSheet& blockTextureSheet,
-		const IntVec2& topfaceSpriteCoords, const IntVec2& botfaceSpriteCoords, const IntVec2& sidefaceSpriteCoords);
+		const IntVec2& topfaceSpriteCoords, const IntVec2& botfaceSpriteCoords, const IntVec2& sidefaceSpriteCoords, BlockShape shape = BLOCK_SHAPE_CUBE, const std::string& modelName = "");
 	static bool IsBlockTypeOpaque(int blockDefIndex);
 	static bool DoesBlockTypeEmitLight(int blockDefIndex);
+	static const AABB2& GetSpriteUVs(int spriteIndex) { return s_spriteUVs[spriteIndex]; }
 };
 
 struct BlockTemplateEntry
@@ -79,4 +116,26 @@ public:
 	bool LoadFromXmlElement(const XmlElement& element);
 	static void InitializeTemplates(const char* path);
 	static BlockTemplate GetTemplateFromName(const std::string& name);
-};
\ No newline at end of file
+};
+
+struct BlockModelBox
+{
+public:
+	IntVec3 m_mins = IntVec3::ZERO;		//0 to BLOCK_MODEL_UNITS on each axis
+	IntVec3 m_maxs = IntVec3::ZERO;
+};
+
+//custom block geometry made of axis aligned boxes, loaded from xml like the block templates
+struct BlockModel
+{
+public:
+	std::string m_name;
+	std::vector<BlockModelBox> m_boxes;
+
+	static std::vector<BlockModel> s_models;
+
+public:
+	bool LoadFromXmlElement(const XmlElement& element);
+	static void InitializeModels(const char* path);
+	static int GetModelIndexFromName(const std::string& name);
+};
@@ -4,11 +4,19 @@
 #include "Engine/Math/IntVec3.hpp"
 #include "Engine/Math/AABB3.hpp"
 
-Block* BlockIterator::GetBlock() const
+const Block* BlockIterator::GetBlock() const
 {
 	if (m_chunkBlockBelongsTo == nullptr)
 		return nullptr;
-	return m_chunkBlockBelongsTo->GetBlock(m_blockIndex);
+	const Chunk& chunk = *m_chunkBlockBelongsTo;
+	return chunk.GetBlock(m_blockIndex);
+}
+
+Block* BlockIterator::GetBlockForWrite() const
+{
+	if (m_chunkBlockBelongsTo == nullptr)
+		return nullptr;
+	return m_chunkBlockBelongsTo->GetBlockForWrite(m_blockIndex);
 }
 
 Vec3 BlockIterator::GetWorldCenter() const
@@ -31,95 +39,83 @@ bool BlockIterator::IsBlockOpaque() const
 	return BlockDefintion::IsBlockTypeOpaque(GetBlock()->m_typeIndex);
 }
 
+bool BlockIterator::IsBlockSky() const
+{
+	return m_chunkBlockBelongsTo->IsBlockSky(m_blockIndex);
+}
+
+uint8_t BlockIterator::GetLightSourceLevel(LightChannel channel) const
+{
+	if (channel == LIGHT_CHANNEL_OUTDOOR)
+		return IsBlockSky() ? 15 : 0;
+
+	return BlockDefintion::s_definitions[GetBlock()->m_typeIndex].m_indoorLightInfluence;
+}
+
+//all neighbour steps work directly on the block index: a masked test tells if the step leaves the chunk,
+//otherwise the index is moved by the step size of that axis
 BlockIterator BlockIterator::GetEastNeighbour() const
 {
-	BlockIterator blockIterator = {};
-	IntVec3 localCoords = m_chunkBlockBelongsTo->GetLocalCoordsFromBlockIndex(m_blockIndex);
-	if (localCoords.x == CHUNK_MAX_X)
-	{
-		blockIterator.m_chunkBlockBelongsTo = m_chunkBlockBelongsTo->m_eastNeighbour;
-		blockIterator.m_blockIndex = Chunk::GetBlockIndexFromLocalCoords(IntVec3(0, localCoords.y, localCoords.z));
-		return blockIterator;
-	}
+	if ((m_blockIndex & CHUNK_MASK_X) == CHUNK_MASK_X)
+		return { m_chunkBlockBelongsTo->m_eastNeighbour, m_blockIndex & ~CHUNK_MASK_X };
 
-	blockIterator.m_chunkBlockBelongsTo = m_chunkBlockBelongsTo;
-	blockIterator.m_blockIndex = m_chunkBlockBelongsTo->GetBlockIndexFromLocalCoords(localCoords + IntVec3(1, 0, 0));
-	return blockIterator;
+	return { m_chunkBlockBelongsTo, m_blockIndex + CHUNK_STEP_X };
 }
 
 BlockIterator BlockIterator::GetNorthNeighbour() const
 {
-	BlockIterator blockIterator = {};
-	IntVec3 localCoords = m_chunkBlockBelongsTo->GetLocalCoordsFromBlockIndex(m_blockIndex);
-	if (localCoords.y == CHUNK_MAX_Y)
-	{
-		blockIterator.m_chunkBlockBelongsTo = m_chunkBlockBelongsTo->m_northNeighbour;
-		blockIterator.m_blockIndex = Chunk::GetBlockIndexFromLocalCoords(IntVec3(localCoords.x, 0, localCoords.z));
-		return blockIterator;
-	}
+	if ((m_blockIndex & CHUNK_MASK_Y) == CHUNK_MASK_Y)
+		return { m_chunkBlockBelongsTo->m_northNeighbour, m_blockIndex & ~CHUNK_MASK_Y };
 
-	blockIterator.m_chunkBlockBelongsTo = m_chunkBlockBelongsTo;
-	blockIterator.m_blockIndex = m_chunkBlockBelongsTo->GetBlockIndexFromLocalCoords(localCoords + IntVec3(0, 1, 0));
-	return blockIterator;
+	return { m_chunkBlockBelongsTo, m_blockIndex + CHUNK_STEP_Y };
 }
 
 BlockIterator BlockIterator::GetWestNeighbour() const
 {
-	BlockIterator blockIterator = {};
-	IntVec3 localCoords = m_chunkBlockBelongsTo->GetLocalCoordsFromBlockIndex(m_blockIndex);
-	if (localCoords.x == 0)
-	{
-		blockIterator.m_chunkBlockBelongsTo = m_chunkBlockBelongsTo->m_westNeighbour;
-		blockIterator.m_blockIndex = Chunk::GetBlockIndexFromLocalCoords(IntVec3(CHUNK_MAX_X, localCoords.y, localCoords.z));
-		return blockIterator;
-	}
+	if ((m_blockIndex & CHUNK_MASK_X) == 0)
+		return { m_chunkBlockBelongsTo->m_westNeighbour, m_blockIndex | CHUNK_MASK_X };
 
-	blockIterator.m_chunkBlockBelongsTo = m_chunkBlockBelongsTo;
-	blockIterator.m_blockIndex = m_chunkBlockBelongsTo->GetBlockIndexFromLocalCoords(localCoords + IntVec3(-1, 0, 0));
-	return blockIterator;
+	return { m_chunkBlockBelongsTo, m_blockIndex - CHUNK_STEP_X };
 }
 
 BlockIterator BlockIterator::GetSouthNeighbour() const
 {
-	BlockIterator blockIterator = {};
-	IntVec3 localCoords = m_chunkBlockBelongsTo->GetLocalCoordsFromBlockIndex(m_blockIndex);
-	if (localCoords.y == 0)
-	{
-		blockIterator.m_chunkBlockBelongsTo = m_chunkBlockBelongsTo->m_southNeighbour;
-		blockIterator.m_blockIndex = Chunk::GetBlockIndexFromLocalCoords(IntVec3(localCoords.x, CHUNK_MAX_Y, localCoords.z));
-		return blockIterator;
-	}
+	if ((m_blockIndex & CHUNK_MASK_Y) == 0)
+		return { m_chunkBlockBelongsTo->m_southNeighbour, m_blockIndex | CHUNK_MASK_Y };
 
-	blockIterator.m_chunkBlockBelongsTo = m_chunkBlockBelongsTo;
-	blockIterator.m_blockIndex = m_chunkBlockBelongsTo->GetBlockIndexFromLocalCoords(localCoords + IntVec3(0, -1, 0));
-	return blockIterator;
+	return { m_chunkBlockBelongsTo, m_blockIndex - CHUNK_STEP_Y };
 }
 
 BlockIterator BlockIterator::GetAboveNeighbour() const
 {
-	BlockIterator blockIterator = {};
-	IntVec3 localCoords = m_chunkBlockBelongsTo->GetLocalCoordsFromBlockIndex(m_blockIndex);
-	if (localCoords.z == CHUNK_MAX_Z)
-	{
+	//there is no chunk above, the top most block is its own neighbour
+	if ((m_blockIndex & CHUNK_MASK_Z) == CHUNK_MASK_Z)
 		return *this;
-	}
 
-	blockIterator.m_chunkBlockBelongsTo = m_chunkBlockBelongsTo;
-	blockIterator.m_blockIndex = m_chunkBlockBelongsTo->GetBlockIndexFromLocalCoords(localCoords + IntVec3(0, 0, 1));
-	return blockIterator;
+	return { m_chunkBlockBelongsTo, m_blockIndex + CHUNK_STEP_Z };
 }
 
 BlockIterator BlockIterator::GetBelowNeighbour() const
 {
-	BlockIterator blockIterator = {};
-	IntVec3 localCoords = m_chunkBlockBelongsTo->GetLocalCoordsFromBlockIndex(m_blockIndex);
-	if (localCoords.z == 0)
-	{
+	//there is no chunk below, the bottom most block is its own neighbour
+	if ((m_blockIndex & CHUNK_MASK_Z) == 0)
 		return *this;
-	}
 
-	blockIterator.m_chunkBlockBelongsTo = m_chunkBlockBelongsTo;
-	blockIterator.m_blockIndex = m_chunkBlockBelongsTo->GetBlockIndexFromLocalCoords(localCoords + IntVec3(0, 0, -1));
-	return blockIterator;
+	return { m_chunkBlockBelongsTo, m_blockIndex - CHUNK_STEP_Z };
 }
 
+int BlockIterator::GetNeighbours(BlockIterator* out_neighbours) const
+{
+	int numNeighbours = 0;
+	BlockIterator horizontalNeighbours[4] = { GetEastNeighbour(), GetWestNeighbour(), GetNorthNeighbour(), GetSouthNeighbour() };
+	for (int i = 0; i < 4; i++)
+	{
+		if (horizontalNeighbours[i].m_chunkBlockBelongsTo)
+			out_neighbours[numNeighbours++] = horizontalNeighbours[i];
+	}
+	if ((m_blockIndex & CHUNK_MASK_Z) != CHUNK_MASK_Z)
+		out_neighbours[numNeighbours++] = { m_chunkBlockBelongsTo, m_blockIndex + CHUNK_STEP_Z };
+	if ((m_blockIndex & CHUNK_MASK_Z) != 0)
+		out_neighbours[numNeighbours++] = { m_chunkBlockBelongsTo, m_blockIndex - CHUNK_STEP_Z };
+	return numNeighbours;
+}
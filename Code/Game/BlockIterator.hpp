@@ -1,9 +1,11 @@
 #pragma once
+#include <stdint.h>
 #include "Engine/Math/Vec3.hpp"
 #include "Engine/Math/AABB3.hpp"
 
 class Chunk;
 struct Block;
+enum LightChannel : uint8_t;
 
 struct BlockIterator
 {
@@ -12,10 +14,14 @@ public:
 	int m_blockIndex = 0;
 
 public:
-	Block* GetBlock() const;
+	const Block* GetBlock() const;
+	Block* GetBlockForWrite() const;		//only for changing the block, it stops the chunk sharing its blocks with snapshots
 	Vec3 GetWorldCenter() const;
 	AABB3 GetBlockBounds() const;
 	bool IsBlockOpaque() const;
+	bool IsBlockSky() const;
+	//light the block has on its own in a channel, whatever its neighbours are: full sky light for sky blocks, its emission for emitting blocks
+	uint8_t GetLightSourceLevel(LightChannel channel) const;
 
 	BlockIterator GetEastNeighbour() const;
 	BlockIterator GetNorthNeighbour() const;
@@ -23,6 +29,7 @@ public:
 	BlockIterator GetSouthNeighbour() const;
 	BlockIterator GetAboveNeighbour() const;
 	BlockIterator GetBelowNeighbour() const;
-
+	//the up to six neighbours that exist in the loaded world, returns how many there are
+	int GetNeighbours(BlockIterator* out_neighbours) const;
 
 };
\ No newline at end of file
@@ -1,9 +1,10 @@
+#include <algorithm>
+#include <cstring>
 #include "Engine/Core/VertexUtils.hpp"
 #include "Engine/Math/IntVec3.hpp"
 #include "Engine/Core/EngineCommon.hpp"
 #include "Engine/Renderer/Renderer.hpp"
 #include "Engine/Renderer/VertexBuffer.hpp"
-#include "Engine/Renderer/IndexBuffer.hpp"
 #include "Engine/Math/RandomNumberGenerator.hpp"
 #include "Engine/Core/ErrorWarningAssert.hpp"
 #include "Engine/Core/FileUtils.hpp"
@@ -16,6 +17,9 @@
 #include "Game/Chunk.hpp"
 #include "Game/World.hpp"
 #include "Game/BlockIterator.hpp"
+#include "Game/ChunkMesher.hpp"
+#include "Game/ChunkMeshCache.hpp"
+#include "Game/ChunkLighting.hpp"
 
 extern Renderer* g_theRenderer;
 extern DevConsole* g_theConsole;
@@ -24,40 +28,36 @@ extern JobSystem* g_theJobSystem;
 constexpr float MAX_SAND_BLOCKS = 4;
 constexpr float MAX_ICE_BLOCKS = 4;
 constexpr float MAX_SNOW_BLOCKS = 3;
-constexpr int SEA_LEVEL = CHUNK_SIZE_Z / 2;
-constexpr int MAX_OCEAN_DEPTH = 55;
-constexpr int FREEZING_LEVEL = 87;
-constexpr int CLOUD_LEVEL = 110;
+//world generation heights are tuned for 128 block tall chunks and scale with the chunk height
+constexpr int MAX_OCEAN_DEPTH = SEA_LEVEL - 9;
+constexpr int MIN_TERRAIN_HEIGHT = SEA_LEVEL - 1;
+constexpr int FREEZING_LEVEL = (CHUNK_SIZE_Z * 87) / 128;
+constexpr int CLOUD_LEVEL = (CHUNK_SIZE_Z * 110) / 128;
+
+//version 2 added the block byte count after the header and the optional light section after the blocks
+constexpr uint8_t CHUNK_SAVE_VERSION = 2;
+constexpr size_t CHUNK_SAVE_HEADER_SIZE = 8;
+constexpr size_t CHUNK_SAVE_LIGHT_HEADER_SIZE = 5 * sizeof(uint64_t);		//light input hash and the four neighbour border hashes
 
 Chunk::Chunk(World* world, const IntVec2& chunkCoordinates)
 	:m_world(world), m_chunkCoords(chunkCoordinates)
 {
 	Vec3 mins = Vec3(float(CHUNK_SIZE_X * m_chunkCoords.x), float(CHUNK_SIZE_Y * m_chunkCoords.y), 0.f);
 	m_worldBounds = AABB3(mins, mins + Vec3(CHUNK_SIZE_X, CHUNK_SIZE_Y, CHUNK_SIZE_Z));
-	m_cpuMeshOpaqueVertices.reserve(3000);
-	m_cpuMeshOpaqueIndicies.reserve(3000);
-	m_cpuMeshTranslucentVertices.reserve(3000);
-	m_cpuMeshTranslucentIndicies.reserve(3000);
+	m_meshSlices = new ChunkMeshData[CHUNK_NUM_MESH_SLICES];
 }
 
 Chunk::~Chunk()
 {
  	GUARANTEE_OR_DIE(this != nullptr, "Trying to delete chunk that does not exist");
 
-	if (m_needsSaving)
-	{
-		float startTime = (float)GetCurrentTimeSeconds();
-		SaveBlockToFile();
-		float endTime = (float)GetCurrentTimeSeconds();
-		g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("Chunk [%d, %d] took %f time to save to disk", m_chunkCoords.x, m_chunkCoords.y, (endTime - startTime) * 1000.f));
-		m_needsSaving = false;
-	}
-	delete[] m_blocks;
+	//chunks deactivated during play are saved by a ChunkSaveJob and the world saves the rest before it deletes them, this only catches anything left over
+	SaveBlocksIfNeeded();
 	m_blocks = nullptr;
-	delete m_gpuMeshOpaqueVBO;
-	m_gpuMeshOpaqueVBO = nullptr;
-	delete m_gpuMeshOpaqueIBO;
-	m_gpuMeshOpaqueIBO = nullptr;
+	m_blockData = nullptr;
+	delete[] m_meshSlices;
+	m_meshSlices = nullptr;
+	DeleteGpuMesh();
 }
 
 void Chunk::Update(float deltaSeconds)
@@ -65,20 +65,26 @@ void Chunk::Update(float deltaSeconds)
 	UNUSED(deltaSeconds);
 }
 
-void Chunk::Render() const
+void Chunk::Render(ChunkMeshPass pass) const
 {
-	if (!m_gpuMeshOpaqueVBO)
+	if (m_numGpuMeshQuads[pass] == 0)
 		return;
 
- 	g_theRenderer->BindVertexBuffer(m_gpuMeshOpaqueVBO);
-	g_theRenderer->BindIndexBuffer(m_gpuMeshOpaqueIBO);
-	g_theRenderer->DrawIndexed((int)m_cpuMeshOpaqueIndicies.size());
+	//packed vertices are in chunk local coordinates
+	if (m_world->IsUsingPackedChunkVertices())
+	{
+		g_theRenderer->SetModelMatrix(Mat44::CreateTranslation3D(m_worldBounds.m_mins));
+	}
 
-	if (m_gpuMeshTranslucentVBO)
+	//every slice starts at the first vertex of its own buffer, so they all share the world's quad index buffer
+	g_theRenderer->BindIndexBuffer(m_world->GetQuadIndexBuffer());
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
 	{
-		g_theRenderer->BindVertexBuffer(m_gpuMeshTranslucentVBO);
-		g_theRenderer->BindIndexBuffer(m_gpuMeshTranslucentIBO);
-		g_theRenderer->DrawIndexed((int)m_cpuMeshTranslucentIndicies.size());
+		if (m_gpuMeshSliceVBOs[pass][slice] == nullptr)
+			continue;
+
+		g_theRenderer->BindVertexBuffer(m_gpuMeshSliceVBOs[pass][slice]);
+		g_theRenderer->DrawIndexed(m_numGpuMeshSliceQuads[pass][slice] * 6);
 	}
 }
 
@@ -109,65 +115,298 @@ IntVec3 Chunk::GetLocalCoordsFromBlockIndex(int blockIndex) const
 
 int Chunk::GetZHeightOfHighestNonAirBlock(int columnX, int columnY) const
 {
-	for (int z = 0; z < CHUNK_SIZE_Z; z++)
-	{
-		uint8_t blockType = m_blocks[GetBlockIndexFromLocalCoords(IntVec3(columnX, columnY, z))].m_typeIndex;
-		if (BlockDefintion::s_definitions[blockType].m_name == "air")
-		{
-			//get highest air block height and return the height of the block one below it.
-			return z - 1;
-		}
-	}
+	return m_blockData->m_highestNonAirZ[columnX | (columnY << CHUNK_BITS_X)];
+}
 
-	return CHUNK_MAX_Z;
+int Chunk::GetZHeightOfHighestOpaqueBlock(int columnX, int columnY) const
+{
+	return m_blockData->m_highestOpaqueZ[columnX | (columnY << CHUNK_BITS_X)];
 }
 
 void Chunk::DigBlock(const BlockIterator& blockIter)
 {
+	MarkBlockDataChanged();
 	int blockIndex = blockIter.m_blockIndex;
-	uint8_t dugState = blockIter.GetBlock()->GetCurrentDugState();
-	if (dugState >= BlockDefintion::s_digCrackUVs.size())
-	{
-		m_blocks[blockIndex].m_typeIndex = BlockDefintion::GetDefinitionIndexByName("air");
-	}
-	else
+	uint8_t dugState = GetBlockDigState(blockIndex);
+	m_needsSaving = true;
+	if (dugState < BlockDefintion::s_digCrackUVs.size())
 	{
-		blockIter.GetBlock()->IncrementDugState();
+		//the crack is drawn by the world's dig overlay, the chunk's mesh only changes once the block is gone
+		GetOrCreateBlockMetadata(blockIndex).m_digState++;
+		return;
 	}
-	m_isChunkDirty = true;
-	m_needsSaving = true;
 
-	blockIter.GetWestNeighbour().m_chunkBlockBelongsTo->SetChunkToDirty();
-	blockIter.GetEastNeighbour().m_chunkBlockBelongsTo->SetChunkToDirty();
-	blockIter.GetSouthNeighbour().m_chunkBlockBelongsTo->SetChunkToDirty();
-	blockIter.GetNorthNeighbour().m_chunkBlockBelongsTo->SetChunkToDirty();
+	m_blocks[blockIndex].m_typeIndex = BlockDefintion::GetDefinitionIndexByName("air");
+	ClearBlockMetadata(blockIndex);
+	int previousHighestOpaqueZ = m_blockData->m_highestOpaqueZ[blockIndex & (CHUNK_MASK_X | CHUNK_MASK_Y)];
+	m_blockData->UpdateColumnHeightsForBlock(blockIndex);
+	SetMeshDirtyForEditedBlock(blockIter);
 
-	ProcessLightingForDugBlock(blockIter);
+	ProcessLightingForEditedBlock(blockIter, previousHighestOpaqueZ);
 }
 
 void Chunk::AddBlock(const BlockIterator& blockIter)
 {
+	MarkBlockDataChanged();
 	int blockIndex = blockIter.m_blockIndex;
 	m_blocks[blockIndex].m_typeIndex = static_cast<uint8_t>(m_world->m_blockTypeToAdd);
-	m_isChunkDirty = true;
+	ClearBlockMetadata(blockIndex);
+	int previousHighestOpaqueZ = m_blockData->m_highestOpaqueZ[blockIndex & (CHUNK_MASK_X | CHUNK_MASK_Y)];
+	m_blockData->UpdateColumnHeightsForBlock(blockIndex);
 	m_needsSaving = true;
+	SetMeshDirtyForEditedBlock(blockIter);
 
-	ProcessLightingForAddedBlock(blockIter);
+	ProcessLightingForEditedBlock(blockIter, previousHighestOpaqueZ);
 }
 
 void Chunk::SetChunkToDirty()
 {
-	m_isChunkDirty = true;
+	MarkMeshSlicesDirty(ALL_CHUNK_MESH_SLICES);
+}
+
+void Chunk::SetMeshDirtyForBlock(int blockIndex)
+{
+	MarkMeshSlicesDirty(GetMeshSlicesTouchingBlock(blockIndex));
 }
 
-Block* Chunk::GetBlock(int blockIndex) const
+void Chunk::SetMeshDirtyForLightChange(int blockIndex)
 {
+	m_lightChangedMeshSlices |= GetMeshSlicesTouchingBlock(blockIndex);
+	QueueForLighting();
+}
+
+uint32_t Chunk::GetMeshSlicesTouchingBlock(int blockIndex)
+{
+	//the faces of the blocks above and below also touch this block, and they may sit in the neighbouring slices
+	int z = blockIndex >> (CHUNK_BITS_X + CHUNK_BITS_Y);
+	int minSlice = (z > 0 ? z - 1 : 0) >> CHUNK_MESH_SLICE_BITS;
+	int maxSlice = (z < CHUNK_MAX_Z ? z + 1 : CHUNK_MAX_Z) >> CHUNK_MESH_SLICE_BITS;
+	uint32_t slices = 0;
+	for (int slice = minSlice; slice <= maxSlice; slice++)
+	{
+		slices |= 1u << slice;
+	}
+	return slices;
+}
+
+void Chunk::MarkLightingDirty(int blockIndex)
+{
+	if (m_dirtyLightBlockBits.empty())
+		m_dirtyLightBlockBits.resize(CHUNK_TOTAL_BLOCKS / 64);
+
+	uint64_t& bits = m_dirtyLightBlockBits[blockIndex >> 6];
+	uint64_t blockBit = uint64_t(1) << (blockIndex & 63);
+	if (bits & blockBit)
+		return;
+
+	bits |= blockBit;
+	m_dirtyLightBlocks.push_back(blockIndex);
+	QueueForLighting();
+}
+
+void Chunk::QueueLightIncrease(int blockIndex, LightChannel channel, uint8_t level)
+{
+	m_lightIncreaseQueue.push_back({ blockIndex, channel, level });
+	QueueForLighting();
+}
+
+void Chunk::QueueLightDecrease(int blockIndex, LightChannel channel, uint8_t level)
+{
+	m_lightDecreaseQueue.push_back({ blockIndex, channel, level });
+	QueueForLighting();
+}
+
+bool Chunk::PopDirtyLightBlock(int& out_blockIndex)
+{
+	if (m_dirtyLightBlocks.empty())
+		return false;
+
+	out_blockIndex = m_dirtyLightBlocks.front();
+	m_dirtyLightBlocks.pop_front();
+	m_dirtyLightBlockBits[out_blockIndex >> 6] &= ~(uint64_t(1) << (out_blockIndex & 63));
+	if (m_dirtyLightBlocks.empty())
+		std::vector<uint64_t>().swap(m_dirtyLightBlockBits);
+	return true;
+}
+
+bool Chunk::PopLightDecrease(LightQueueEntry& out_entry)
+{
+	if (m_lightDecreaseQueue.empty())
+		return false;
+
+	out_entry = m_lightDecreaseQueue.front();
+	m_lightDecreaseQueue.pop_front();
+	return true;
+}
+
+bool Chunk::PopLightIncrease(LightQueueEntry& out_entry)
+{
+	if (m_lightIncreaseQueue.empty())
+		return false;
+
+	out_entry = m_lightIncreaseQueue.front();
+	m_lightIncreaseQueue.pop_front();
+	return true;
+}
+
+void Chunk::QueueForLighting()
+{
+	if (m_isQueuedForLighting)
+		return;
+
+	m_isQueuedForLighting = true;
+	m_world->QueueChunkForLighting(*this);
+}
+
+bool Chunk::IsLightingSettled() const
+{
+	//light still spreading in a neighbour may come back across the border, so the neighbours have to be done too
+	if (HasDirtyLighting())
+		return false;
+
+	const Chunk* neighbours[4] = { m_northNeighbour, m_eastNeighbour, m_southNeighbour, m_westNeighbour };
+	for (int i = 0; i < 4; i++)
+	{
+		if (neighbours[i] && neighbours[i]->HasDirtyLighting())
+			return false;
+	}
+	return true;
+}
+
+void Chunk::OnLightingSettled()
+{
+	m_isQueuedForLighting = false;
+	uint32_t slices = m_lightChangedMeshSlices;
+	m_lightChangedMeshSlices = 0;
+	MarkMeshSlicesDirty(slices);
+}
+
+void Chunk::QueueMeshRebuildIfDirty()
+{
+	if (m_dirtyMeshSlices == 0 || m_isQueuedForMeshRebuild)
+		return;
+
+	m_isQueuedForMeshRebuild = true;
+	m_world->QueueChunkForMeshRebuild(*this);
+}
+
+void Chunk::OnRemovedFromMeshRebuildQueue()
+{
+	//a chunk that could not be rebuilt yet is queued again by whatever unblocks it (job finished, mesh restored or edited)
+	m_isQueuedForMeshRebuild = false;
+}
+
+void Chunk::OnNeighbourActivated(const Chunk& neighbour)
+{
+	IntVec2 offset = neighbour.m_chunkCoords - m_chunkCoords;
+	uint8_t side = offset.y > 0 ? CHUNK_SIDE_NORTH : offset.x > 0 ? CHUNK_SIDE_EAST : offset.y < 0 ? CHUNK_SIDE_SOUTH : CHUNK_SIDE_WEST;
+	if ((m_provisionalMeshSides & side) == 0)
+		return;
+
+	m_provisionalMeshSides &= ~side;
+
+	//the provisional mesh hid every face on this side, only slices where a visible block now looks out at a non opaque one gain faces
+	bool alongX = side == CHUNK_SIDE_NORTH || side == CHUNK_SIDE_SOUTH;
+	int borderLength = alongX ? CHUNK_SIZE_X : CHUNK_SIZE_Y;
+	int ownBorder = (side == CHUNK_SIDE_NORTH) ? CHUNK_MAX_Y : (side == CHUNK_SIDE_EAST) ? CHUNK_MAX_X : 0;
+	int neighbourBorder = (side == CHUNK_SIDE_SOUTH) ? CHUNK_MAX_Y : (side == CHUNK_SIDE_WEST) ? CHUNK_MAX_X : 0;
+	uint32_t slices = 0;
+	for (int z = 0; z < CHUNK_SIZE_Z; z++)
+	{
+		uint32_t sliceBit = 1u << (z >> CHUNK_MESH_SLICE_BITS);
+		if (slices & sliceBit)
+			continue;
+
+		for (int i = 0; i < borderLength; i++)
+		{
+			IntVec3 ownCoords = alongX ? IntVec3(i, ownBorder, z) : IntVec3(ownBorder, i, z);
+			IntVec3 neighbourCoords = alongX ? IntVec3(i, neighbourBorder, z) : IntVec3(neighbourBorder, i, z);
+			const Block& ownBlock = m_blocks[GetBlockIndexFromLocalCoords(ownCoords)];
+			const Block& neighbourBlock = neighbour.m_blocks[GetBlockIndexFromLocalCoords(neighbourCoords)];
+			if (BlockDefintion::s_definitions[ownBlock.m_typeIndex].m_visible && !BlockDefintion::IsBlockTypeOpaque(neighbourBlock.m_typeIndex))
+			{
+				slices |= sliceBit;
+				break;
+			}
+		}
+	}
+
+	if (slices != 0)
+	{
+		MarkMeshSlicesDirty(slices);
+	}
+}
+
+void Chunk::MarkMeshSlicesDirty(uint32_t slices)
+{
+	m_dirtyMeshSlices |= slices;
+	QueueMeshRebuildIfDirty();
+}
+
+void Chunk::SetMeshDirtyForEditedBlock(const BlockIterator& blockIter)
+{
+	SetMeshDirtyForBlock(blockIter.m_blockIndex);
+
+	//a neighbouring chunk's mesh only sees the block when it sits on the face the two chunks share
+	BlockIterator neighbours[4] = { blockIter.GetWestNeighbour(), blockIter.GetEastNeighbour(), blockIter.GetSouthNeighbour(), blockIter.GetNorthNeighbour() };
+	for (int i = 0; i < 4; i++)
+	{
+		Chunk* neighbourChunk = neighbours[i].m_chunkBlockBelongsTo;
+		if (neighbourChunk && neighbourChunk != this)
+			neighbourChunk->SetMeshDirtyForBlock(neighbours[i].m_blockIndex);
+	}
+}
+
+const Block* Chunk::GetBlock(int blockIndex) const
+{
+	return &m_blocks[blockIndex];
+}
+
+Block* Chunk::GetBlockForWrite(int blockIndex)
+{
+	//handing out a writable block means the shared data can no longer be shared
+	if (m_isBlockDataShared)
+		DetachSharedBlockData();
 	return &m_blocks[blockIndex];
 }
 
+const BlockMetadata* Chunk::GetBlockMetadata(int blockIndex) const
+{
+	const std::unordered_map<int, BlockMetadata>& blockMetadata = m_blockData->m_blockMetadata;
+	if (blockMetadata.empty())
+		return nullptr;
+
+	auto iter = blockMetadata.find(blockIndex);
+	if (iter == blockMetadata.end())
+		return nullptr;
+
+	return &iter->second;
+}
+
+BlockMetadata& Chunk::GetOrCreateBlockMetadata(int blockIndex)
+{
+	if (m_isBlockDataShared)
+		DetachSharedBlockData();
+	return m_blockData->m_blockMetadata[blockIndex];
+}
+
+void Chunk::ClearBlockMetadata(int blockIndex)
+{
+	if (m_isBlockDataShared)
+		DetachSharedBlockData();
+	m_blockData->m_blockMetadata.erase(blockIndex);
+}
+
+uint8_t Chunk::GetBlockDigState(int blockIndex) const
+{
+	const BlockMetadata* metadata = GetBlockMetadata(blockIndex);
+	return metadata ? metadata->m_digState : 0;
+}
+
 void Chunk::InitializeBlocks()
 {
-	m_blocks = new Block[CHUNK_TOTAL_BLOCKS];
+	m_blockData = std::make_shared<ChunkBlockData>();
+	m_blocks = m_blockData->m_blocks;
 	RandomNumberGenerator rng;
 
 	float startTime = (float)GetCurrentTimeSeconds();
@@ -199,7 +438,10 @@ void Chunk::InitializeBlocks()
 				float hilliness = Compute2dPerlinNoise(float(globalCoords.x), float(globalCoords.y), 800.f, 2, 0.5f, 2.f, true, m_world->m_worldSeed + 3);
 				hilliness = RangeMapClamped(hilliness, -1.f, 1.f, 0.f, 1.f);
 				float hillinessWithTerrainNoise = SmoothStep3(hilliness * fabsf(terrainHeightNoisePerColumn[columnIndex]));
-				terrainHeightPerColumn[columnIndex] = int(RangeMapClamped(hillinessWithTerrainNoise, 0.f, 1.f, 63.f, CHUNK_SIZE_Z));
+				terrainHeightPerColumn[columnIndex] = int(RangeMapClamped(hillinessWithTerrainNoise, 0.f, 1.f, float(MIN_TERRAIN_HEIGHT), float(CHUNK_SIZE_Z)));
+				//keep room above the terrain for the block a tree is planted on
+				if (terrainHeightPerColumn[columnIndex] > CHUNK_MAX_Z - 1)
+					terrainHeightPerColumn[columnIndex] = CHUNK_MAX_Z - 1;
 			}
 		}
 
@@ -374,298 +616,493 @@ void Chunk::InitializeBlocks()
 			}
 		}
 	}
+
+	m_blockData->ComputeColumnHeights();
 }
 
 bool Chunk::ShouldRebuildMesh() const
 {
-	return m_isChunkDirty && HasAllValidNeighbours();
+	//a mesh built while the light is still spreading would have to be built again as soon as it settles
+	return m_dirtyMeshSlices != 0 && !m_isMeshJobPending && !m_isMeshEvicted && !m_isQueuedForLighting;
 }
 
-void Chunk::InitializeLighting()
+ChunkSnapshot Chunk::TakeSnapshot()
+{
+	//taking a snapshot only shares the current data, the copy is made by the first write that happens while it is still shared
+	m_isBlockDataShared = true;
+	return m_blockData;
+}
+
+void Chunk::MarkBlockDataChanged()
 {
-	//mark non opaque blocks at the edge of a chunk as dirty
-	for (int i = 0; i < CHUNK_TOTAL_BLOCKS; i++)
+	if (m_isBlockDataShared)
+		DetachSharedBlockData();
+	m_blockData->m_version++;
+}
+
+ChunkSaveJob* Chunk::CreateSaveJob()
+{
+	ChunkMeshCache* meshCache = TakeMeshCacheToSave();
+	if (!m_needsSaving)
+		return meshCache ? new ChunkSaveJob(m_chunkCoords, nullptr, "", nullptr, meshCache) : nullptr;
+
+	m_needsSaving = false;
+	uint64_t borderLightHashes[4] = {};
+	bool saveLight = GetBorderLightHashesForSave(borderLightHashes);
+	return new ChunkSaveJob(m_chunkCoords, TakeSnapshot(), GetSaveFilePath(), saveLight ? borderLightHashes : nullptr, meshCache);
+}
+
+void Chunk::SaveBlocksIfNeeded()
+{
+	if (!m_needsSaving)
+		return;
+
+	float startTime = (float)GetCurrentTimeSeconds();
+	uint64_t borderLightHashes[4] = {};
+	bool saveLight = GetBorderLightHashesForSave(borderLightHashes);
+	SaveBlocksToFile(*m_blockData, GetSaveFilePath(), saveLight ? borderLightHashes : nullptr);
+	float endTime = (float)GetCurrentTimeSeconds();
+	g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("Chunk [%d, %d] took %f time to save to disk", m_chunkCoords.x, m_chunkCoords.y, (endTime - startTime) * 1000.f));
+	m_needsSaving = false;
+}
+
+void Chunk::SaveMeshCacheIfNeeded()
+{
+	//only for when the world shuts down, during play the mesh cache is written by save jobs
+	ChunkMeshCache* meshCache = TakeMeshCacheToSave();
+	if (meshCache == nullptr)
+		return;
+
+	meshCache->SaveToFile();
+	delete meshCache;
+}
+
+ChunkMeshCache* Chunk::TakeMeshCacheToSave()
+{
+	//the slices are moved out, so this is only called when the cpu mesh is dropped right after
+	if (!HasUnsavedMeshCache())
+		return nullptr;
+
+	ChunkMeshCache* meshCache = new ChunkMeshCache(GetMeshCacheFilePath());
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
 	{
-		Block& block = m_blocks[i];
-		if (!BlockDefintion::IsBlockTypeOpaque(block.m_typeIndex))
-		{
-			IntVec3 localCoords = GetLocalCoordsFromBlockIndex(i);
-			if (localCoords.x == 0 || localCoords.x == CHUNK_MAX_X || 
-				localCoords.y == 0 || localCoords.y == CHUNK_MAX_Y ||
-				localCoords.z == 0 || localCoords.z == CHUNK_MAX_Z)
-			{
-				BlockIterator iter = { this, i };
-				m_world->MarkLightingDirty(iter);
-			}
-		}
+		meshCache->TakeSlice(slice, m_meshSliceKeys[slice], m_meshSlices[slice]);
 	}
+	m_hasUnsavedMeshSlices = false;
+	return meshCache;
+}
 
-	//make blocks as sky which are in direct line of sight of the sky
-	for (int y = 0; y < CHUNK_SIZE_Y; y++)
+bool Chunk::GetBorderLightHashesForSave(uint64_t* out_borderLightHashes) const
+{
+	//light that is still spreading would be saved half done
+	if (m_isQueuedForLighting || HasDirtyLighting())
+		return false;
+
+	const Chunk* neighbours[4] = { m_northNeighbour, m_eastNeighbour, m_southNeighbour, m_westNeighbour };
+	const uint8_t facingSides[4] = { CHUNK_SIDE_SOUTH, CHUNK_SIDE_WEST, CHUNK_SIDE_NORTH, CHUNK_SIDE_EAST };
+	const uint8_t sides[4] = { CHUNK_SIDE_NORTH, CHUNK_SIDE_EAST, CHUNK_SIDE_SOUTH, CHUNK_SIDE_WEST };
+	for (int i = 0; i < 4; i++)
 	{
-		for (int x = 0; x < CHUNK_SIZE_X; x++)
-		{
-			int z = CHUNK_MAX_Z;
-			int blockIndex = GetBlockIndexFromLocalCoords(IntVec3(x, y, z));
-			Block* block = &m_blocks[blockIndex];
-			while (!BlockDefintion::IsBlockTypeOpaque(block->m_typeIndex))
-			{
-				block->SetIsBlockSky(true);
-				z--;
-				blockIndex = GetBlockIndexFromLocalCoords(IntVec3(x, y, z));
-				block = &m_blocks[blockIndex];
-			}
-		}
+		if (neighbours[i])
+			out_borderLightHashes[i] = neighbours[i]->ComputeBorderLightHash(facingSides[i]);
+		else if (m_unverifiedLightSides & sides[i])
+			out_borderLightHashes[i] = m_loadedBorderLightHashes[i];		//the light still holds whatever the neighbour it was loaded with brought in
+		else
+			out_borderLightHashes[i] = 0;
 	}
+	return true;
+}
 
-	//set each sky blocks outdoor lighting influence to max and dirty it's neighbouring blocks
-	for (int y = 0; y < CHUNK_SIZE_Y; y++)
+uint64_t Chunk::ComputeBorderLightHash(uint8_t side) const
+{
+	//what light crosses a side depends only on the type and light of the blocks right at it
+	bool alongX = side == CHUNK_SIDE_NORTH || side == CHUNK_SIDE_SOUTH;
+	int borderLength = alongX ? CHUNK_SIZE_X : CHUNK_SIZE_Y;
+	int border = (side == CHUNK_SIDE_NORTH) ? CHUNK_MAX_Y : (side == CHUNK_SIDE_EAST) ? CHUNK_MAX_X : 0;
+	uint64_t hash = FNV_OFFSET_BASIS;
+	for (int z = 0; z < CHUNK_SIZE_Z; z++)
 	{
-		for (int x = 0; x < CHUNK_SIZE_X; x++)
+		for (int j = 0; j < borderLength; j++)
 		{
-			int z = CHUNK_MAX_Z;
-			int blockIndex = GetBlockIndexFromLocalCoords(IntVec3(x, y, z));
-			Block* block = &m_blocks[blockIndex];
-			while (!BlockDefintion::IsBlockTypeOpaque(block->m_typeIndex))
-			{
-				block->SetOutdoorLightInfluence(15);
-
-				BlockIterator blockIter = { this, blockIndex };
-				m_world->MarkLightingDirtyIfNotSkyAndNotOpaque(blockIter.GetNorthNeighbour());
-				m_world->MarkLightingDirtyIfNotSkyAndNotOpaque(blockIter.GetEastNeighbour());
-				m_world->MarkLightingDirtyIfNotSkyAndNotOpaque(blockIter.GetSouthNeighbour());
-				m_world->MarkLightingDirtyIfNotSkyAndNotOpaque(blockIter.GetWestNeighbour());
-
-				z--;
-				blockIndex = GetBlockIndexFromLocalCoords(IntVec3(x, y, z));
-				block = &m_blocks[blockIndex];
-			}
+			const Block& block = m_blocks[GetBlockIndexFromLocalCoords(alongX ? IntVec3(j, border, z) : IntVec3(border, j, z))];
+			hash = (hash ^ block.m_typeIndex) * FNV_PRIME;
+			hash = (hash ^ block.m_lightInfluence) * FNV_PRIME;
 		}
 	}
 
-	for (int i = 0; i < CHUNK_TOTAL_BLOCKS; i++)
+	//0 marks a side that was saved without a neighbour
+	return hash != 0 ? hash : 1;
+}
+
+void Chunk::VerifyLoadedBorderLight(uint8_t side, const Chunk& neighbour)
+{
+	if ((m_unverifiedLightSides & side) == 0)
+		return;
+
+	m_unverifiedLightSides &= ~side;
+	int sideIndex = (side == CHUNK_SIDE_NORTH) ? 0 : (side == CHUNK_SIDE_EAST) ? 1 : (side == CHUNK_SIDE_SOUTH) ? 2 : 3;
+	uint8_t facingSide = (side == CHUNK_SIDE_NORTH) ? CHUNK_SIDE_SOUTH : (side == CHUNK_SIDE_EAST) ? CHUNK_SIDE_WEST : (side == CHUNK_SIDE_SOUTH) ? CHUNK_SIDE_NORTH : CHUNK_SIDE_EAST;
+	if (neighbour.ComputeBorderLightHash(facingSide) == m_loadedBorderLightHashes[sideIndex])
+		return;
+
+	//the neighbour is not what the light was saved with, the light that came in across this side goes dark and is spread again from what is there now
+	bool alongX = side == CHUNK_SIDE_NORTH || side == CHUNK_SIDE_SOUTH;
+	int borderLength = alongX ? CHUNK_SIZE_X : CHUNK_SIZE_Y;
+	int border = (side == CHUNK_SIDE_NORTH) ? CHUNK_MAX_Y : (side == CHUNK_SIDE_EAST) ? CHUNK_MAX_X : 0;
+	for (int z = 0; z < CHUNK_SIZE_Z; z++)
 	{
-		Block& block = m_blocks[i];
-		if (BlockDefintion::DoesBlockTypeEmitLight(block.m_typeIndex))
+		for (int j = 0; j < borderLength; j++)
 		{
-			BlockIterator iter = { this, i };
-			m_world->MarkLightingDirty(iter);
+			int blockIndex = GetBlockIndexFromLocalCoords(alongX ? IntVec3(j, border, z) : IntVec3(border, j, z));
+			m_world->DarkenBlockLightToSources({ this, blockIndex });
 		}
 	}
+}
 
+void Chunk::DetachSharedBlockData()
+{
+	//snapshots that were already released do not need a copy
+	if (m_blockData.use_count() > 1)
+	{
+		m_blockData = std::make_shared<ChunkBlockData>(*m_blockData);
+		m_blocks = m_blockData->m_blocks;
+	}
+	m_isBlockDataShared = false;
 }
 
-void Chunk::GenerateGeometry()
+void Chunk::InitializeLighting()
 {
-	m_cpuMeshOpaqueVertices.clear();
-	m_cpuMeshOpaqueIndicies.clear();
-	m_cpuMeshTranslucentVertices.clear();
-	m_cpuMeshTranslucentIndicies.clear();
-	double startTime = GetCurrentTimeSeconds();
-	for (int z = 0; z < CHUNK_SIZE_Z; z++)
+	//runs on the generation job, the light of the chunk's own blocks is worked out before it ever reaches the main thread
+	//light loaded from the save file is used as it is
+	if (!m_isLightLoaded)
+		ChunkLighting::ComputeLocalLighting(*m_blockData);
+}
+
+void Chunk::MergeBorderLighting()
+{
+	Chunk* neighbours[4] = { m_northNeighbour, m_eastNeighbour, m_southNeighbour, m_westNeighbour };
+	uint8_t sides[4] = { CHUNK_SIDE_NORTH, CHUNK_SIDE_EAST, CHUNK_SIDE_SOUTH, CHUNK_SIDE_WEST };
+	for (int i = 0; i < 4; i++)
 	{
-		for (int y = 0; y < CHUNK_SIZE_Y; y++)
+		if (neighbours[i] == nullptr)
+			continue;
+
+		//light loaded from a save is only kept where the neighbour still matches the one it was saved with, on either side of the border
+		Chunk& neighbour = *neighbours[i];
+		uint8_t facingSide = (sides[i] == CHUNK_SIDE_NORTH) ? CHUNK_SIDE_SOUTH : (sides[i] == CHUNK_SIDE_EAST) ? CHUNK_SIDE_WEST : (sides[i] == CHUNK_SIDE_SOUTH) ? CHUNK_SIDE_NORTH : CHUNK_SIDE_EAST;
+		VerifyLoadedBorderLight(sides[i], neighbour);
+		neighbour.VerifyLoadedBorderLight(facingSide, *this);
+
+		//both chunks are lit on their own already, only border blocks that the other side would make brighter need to go through the world's light queue
+		bool alongX = sides[i] == CHUNK_SIDE_NORTH || sides[i] == CHUNK_SIDE_SOUTH;
+		int borderLength = alongX ? CHUNK_SIZE_X : CHUNK_SIZE_Y;
+		int ownBorder = (sides[i] == CHUNK_SIDE_NORTH) ? CHUNK_MAX_Y : (sides[i] == CHUNK_SIDE_EAST) ? CHUNK_MAX_X : 0;
+		int neighbourBorder = (sides[i] == CHUNK_SIDE_SOUTH) ? CHUNK_MAX_Y : (sides[i] == CHUNK_SIDE_WEST) ? CHUNK_MAX_X : 0;
+		for (int z = 0; z < CHUNK_SIZE_Z; z++)
 		{
-			for (int x = 0; x < CHUNK_SIZE_X; x++)
+			for (int j = 0; j < borderLength; j++)
 			{
-				IntVec3 localCoords(x, y, z);
-				int index = GetBlockIndexFromLocalCoords(localCoords);
-				BlockDefintion& blockDef = BlockDefintion::s_definitions[m_blocks[index].m_typeIndex];
-				if (blockDef.m_name != "water")
-					AddVertsForBlock(blockDef, localCoords);
-				else
-					AddVertsForWaterBlock(blockDef, localCoords);
+				int ownBlockIndex = GetBlockIndexFromLocalCoords(alongX ? IntVec3(j, ownBorder, z) : IntVec3(ownBorder, j, z));
+				int neighbourBlockIndex = GetBlockIndexFromLocalCoords(alongX ? IntVec3(j, neighbourBorder, z) : IntVec3(neighbourBorder, j, z));
+				const Block& ownBlock = m_blocks[ownBlockIndex];
+				const Block& neighbourBlock = neighbour.m_blocks[neighbourBlockIndex];
+				if (ChunkLighting::DoesLightSpread(neighbourBlock, ownBlock))
+					m_world->MarkLightingDirty({ this, ownBlockIndex });
+				else if (ChunkLighting::DoesLightSpread(ownBlock, neighbourBlock))
+					m_world->MarkLightingDirty({ &neighbour, neighbourBlockIndex });
 			}
 		}
 	}
-	double endTime = GetCurrentTimeSeconds();
-	g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("Chunk [%d, %d] took %f time to build its cpu mesh", m_chunkCoords.x, m_chunkCoords.y, (endTime - startTime) * 1000.f));
+}
+
+ChunkMeshJob* Chunk::CreateMeshJob()
+{
+	ChunkMeshInput input;
+	input.m_chunk = TakeSnapshot();
+	input.m_eastNeighbour = m_eastNeighbour ? m_eastNeighbour->TakeSnapshot() : nullptr;
+	input.m_westNeighbour = m_westNeighbour ? m_westNeighbour->TakeSnapshot() : nullptr;
+	input.m_northNeighbour = m_northNeighbour ? m_northNeighbour->TakeSnapshot() : nullptr;
+	input.m_southNeighbour = m_southNeighbour ? m_southNeighbour->TakeSnapshot() : nullptr;
+	input.m_chunkWorldMins = m_worldBounds.m_mins;
+	input.m_mesherType = m_world->GetChunkMesherType();
+	input.m_decodeToPCU = !m_world->IsUsingPackedChunkVertices();
+	if (m_world->IsUsingChunkMeshCache())
+	{
+		//the first mesh job reads the file, later ones check what it read until a mesh has been built with every neighbour there
+		//a chunk meshed before its neighbours arrive has a provisional border, so its slices only match the file once they are all in
+		input.m_useMeshCache = true;
+		if (!m_hasReadMeshCacheFile)
+		{
+			input.m_meshCacheFilePath = GetMeshCacheFilePath();
+			m_hasReadMeshCacheFile = true;
+		}
+		input.m_loadedMeshCache = m_loadedMeshCache;
+	}
 
-	size_t sizeOfOpaqueVBO = sizeof(*m_cpuMeshOpaqueVertices.data()) * m_cpuMeshOpaqueVertices.size();
-	size_t sizeOfOpaqueIBO = sizeof(*m_cpuMeshOpaqueIndicies.data()) * m_cpuMeshOpaqueIndicies.size();
-	size_t sizeOfTranslucentVBO = sizeof(*m_cpuMeshTranslucentVertices.data()) * m_cpuMeshTranslucentVertices.size();
-	size_t sizeOfTranslucentIBO = sizeof(*m_cpuMeshTranslucentIndicies.data()) * m_cpuMeshTranslucentIndicies.size();
-	if (!m_gpuMeshOpaqueVBO)
+	//the slices that are not rebuilt are needed to put the chunk's mesh back together, without them everything is rebuilt
+	if (m_isCpuMeshReleased)
 	{
-		m_gpuMeshOpaqueVBO = g_theRenderer->CreateVertexBuffer(sizeOfOpaqueVBO, sizeof(m_cpuMeshOpaqueVertices[0]));
+		m_dirtyMeshSlices = ALL_CHUNK_MESH_SLICES;
+		m_isCpuMeshReleased = false;
 	}
-	if (!m_gpuMeshOpaqueIBO)
+	input.m_meshSlices = m_dirtyMeshSlices;
+
+	//chunks at the edge of the loaded area are meshed right away as if their missing neighbours were solid, the neighbour's arrival fixes up the border
+	if (m_northNeighbour == nullptr)
+		m_provisionalMeshSides |= CHUNK_SIDE_NORTH;
+	if (m_eastNeighbour == nullptr)
+		m_provisionalMeshSides |= CHUNK_SIDE_EAST;
+	if (m_southNeighbour == nullptr)
+		m_provisionalMeshSides |= CHUNK_SIDE_SOUTH;
+	if (m_westNeighbour == nullptr)
+		m_provisionalMeshSides |= CHUNK_SIDE_WEST;
+
+	//edits made while the job is running mark their slices dirty again and get picked up by the next job
+	m_dirtyMeshSlices = 0;
+	m_isMeshJobPending = true;
+	return new ChunkMeshJob(m_handle, input);
+}
+
+void Chunk::OnMeshJobFinished(ChunkMeshJob& meshJob)
+{
+	m_isMeshJobPending = false;
+
+	//slices edited while the job was running are dirty again and will be replaced by the next job, until then their slightly stale mesh is still better than the old one
+	int numVertices = 0;
+	int numBuiltSlices = 0;
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
 	{
-		m_gpuMeshOpaqueIBO = g_theRenderer->CreateIndexBuffer(sizeOfOpaqueIBO);
+		if ((meshJob.m_input.m_meshSlices & (1u << slice)) == 0)
+			continue;
+
+		std::swap(m_meshSlices[slice], meshJob.m_meshSlices[slice]);
+		m_meshSliceKeys[slice] = meshJob.m_sliceKeys[slice];
+		numVertices += m_meshSlices[slice].GetNumVertices();
+		numBuiltSlices++;
 	}
-	if (!m_gpuMeshTranslucentVBO && sizeOfTranslucentVBO > 0)
+	if (meshJob.m_input.m_useMeshCache)
 	{
-		m_gpuMeshTranslucentVBO = g_theRenderer->CreateVertexBuffer(sizeOfTranslucentVBO, sizeof(m_cpuMeshTranslucentVertices[0]));
+		//slices loaded from the file are already in it
+		if (numBuiltSlices > meshJob.m_numCachedSlices)
+			m_hasUnsavedMeshSlices = true;
+
+		//slices built with all four neighbours are final, nothing later can match the file any better
+		bool hadAllNeighbours = meshJob.m_input.m_eastNeighbour && meshJob.m_input.m_westNeighbour && meshJob.m_input.m_northNeighbour && meshJob.m_input.m_southNeighbour;
+		if (hadAllNeighbours)
+			m_loadedMeshCache.reset();
+		else
+			m_loadedMeshCache = meshJob.m_loadedMeshCache;
 	}
-	if (!m_gpuMeshTranslucentIBO && sizeOfTranslucentIBO > 0)
+
+	g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("Chunk [%d, %d] took %f time to build %d vertices for its dirty mesh slices, %d slices from the mesh cache", m_chunkCoords.x, m_chunkCoords.y,
+		meshJob.m_meshTimeMs, numVertices, meshJob.m_numCachedSlices));
+	UploadMesh(meshJob.m_input.m_meshSlices);
+	m_isMeshRestorePending = false;
+	if (!m_world->GetChunkMeshResidency()->ShouldKeepCpuMesh(*this))
 	{
-		m_gpuMeshTranslucentIBO = g_theRenderer->CreateIndexBuffer(sizeOfTranslucentIBO);
+		ReleaseCpuMesh();
 	}
 
-	g_theRenderer->CopyCPUToGPU(m_cpuMeshOpaqueVertices.data(), sizeOfOpaqueVBO, m_gpuMeshOpaqueVBO);
-	g_theRenderer->CopyCPUToGPU(m_cpuMeshOpaqueIndicies.data(), sizeOfOpaqueIBO, m_gpuMeshOpaqueIBO);
-	if(m_gpuMeshTranslucentVBO)
-		g_theRenderer->CopyCPUToGPU(m_cpuMeshTranslucentVertices.data(), sizeOfTranslucentVBO, m_gpuMeshTranslucentVBO);
-	if(m_gpuMeshTranslucentIBO)
-		g_theRenderer->CopyCPUToGPU(m_cpuMeshTranslucentIndicies.data(), sizeOfTranslucentIBO, m_gpuMeshTranslucentIBO);
-	m_world->AddToTotalNumberOfVerticesInChunks((int)m_cpuMeshOpaqueVertices.size());
-	m_world->AddToTotalNumberOfVerticesInChunks((int)m_cpuMeshTranslucentVertices.size());
-	m_isChunkDirty = false;
+	//edits made while the job was running could not be rebuilt until now
+	QueueMeshRebuildIfDirty();
 }
 
-void Chunk::AddVertsForBlock(const BlockDefintion& blockDef, const IntVec3& localCoords)
+size_t Chunk::GetCpuMeshBytes() const
 {
-	if (blockDef.m_visible)
+	//the loaded mesh cache is shared with a running mesh job at most, so it is counted here
+	size_t cpuMeshBytes = m_loadedMeshCache ? m_loadedMeshCache->GetMemoryBytes() : 0;
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
 	{
-		Vec3 mins = m_worldBounds.m_mins + Vec3(localCoords);
-		AABB3 bounds = AABB3(mins, mins + Vec3::ONE);
+		cpuMeshBytes += m_meshSlices[slice].GetMemoryBytes();
+	}
 
-		Vec3 near_topLeft(bounds.m_mins.x, bounds.m_maxs.y, bounds.m_maxs.z);
-		Vec3 near_bottomLeft(bounds.m_mins.x, bounds.m_maxs.y, bounds.m_mins.z);
-		Vec3 near_bottomRight(bounds.m_mins.x, bounds.m_mins.y, bounds.m_mins.z);
-		Vec3 near_topRight(bounds.m_mins.x, bounds.m_mins.y, bounds.m_maxs.z);
-		Vec3 far_topLeft(bounds.m_maxs.x, bounds.m_maxs.y, bounds.m_maxs.z);
-		Vec3 far_bottomLeft(bounds.m_maxs.x, bounds.m_maxs.y, bounds.m_mins.z);
-		Vec3 far_bottomRight(bounds.m_maxs.x, bounds.m_mins.y, bounds.m_mins.z);
-		Vec3 far_topRight(bounds.m_maxs.x, bounds.m_mins.y, bounds.m_maxs.z);
+	return cpuMeshBytes;
+}
 
-		BlockIterator blockIter = { this, GetBlockIndexFromLocalCoords(localCoords) };
-		uint8_t currentDugState = blockIter.GetBlock()->GetCurrentDugState();
-		//bottom face
-		if (!BlockDefintion::IsBlockTypeOpaque(blockIter.GetBelowNeighbour().GetBlock()->m_typeIndex))
-		{
-			Rgba8 tileColor = GetFaceColor(blockIter.GetBelowNeighbour());
-			AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, near_bottomLeft, far_bottomLeft, far_bottomRight, near_bottomRight, tileColor, blockDef.m_bottomUVs);
-			if (currentDugState > 0)
-			{
-				Vec3 offset = Vec3(0.f, 0.f, -0.01f);
-				AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, near_bottomLeft + offset, far_bottomLeft + offset,
-					far_bottomRight + offset, near_bottomRight + offset, tileColor, BlockDefintion::s_digCrackUVs[currentDugState - 1]);
-			}
-		}
-		//top face
-		if (!BlockDefintion::IsBlockTypeOpaque(blockIter.GetAboveNeighbour().GetBlock()->m_typeIndex))
-		{
-			Rgba8 tileColor = GetFaceColor(blockIter.GetAboveNeighbour());
-			AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, far_topLeft, near_topLeft, near_topRight, far_topRight, tileColor, blockDef.m_topUVs);
-			if (currentDugState > 0)
-			{
-				Vec3 offset = Vec3(0.f, 0.f, 0.01f);
-				AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, far_topLeft + offset, near_topLeft + offset,
-					near_topRight + offset, far_topRight + offset, tileColor, BlockDefintion::s_digCrackUVs[currentDugState - 1]);
-			}
-		}
-		//side faces
-		if (!BlockDefintion::IsBlockTypeOpaque(blockIter.GetWestNeighbour().GetBlock()->m_typeIndex))	//-x face
+size_t Chunk::GetGpuMeshBytes() const
+{
+	//a restored mesh counts at its old size until it has been rebuilt, so the residency manager does not restore more than fits
+	if (m_isMeshRestorePending)
+		return m_evictedMeshBytes;
+
+	size_t gpuMeshBytes = 0;
+	for (int pass = 0; pass < NUM_CHUNK_MESH_PASSES; pass++)
+	{
+		for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
 		{
-			Rgba8 tileColor = GetFaceColor(blockIter.GetWestNeighbour());
-			AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, near_topLeft, near_bottomLeft, near_bottomRight, near_topRight, tileColor, blockDef.m_sideUVs);
-			if (currentDugState > 0)
-			{
-				Vec3 offset = Vec3(-0.01f, 0.f, 0.f);
-				AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, near_topLeft + offset, near_bottomLeft + offset,
-					near_bottomRight + offset, near_topRight + offset, tileColor, BlockDefintion::s_digCrackUVs[currentDugState - 1]);
-			}
+			gpuMeshBytes += m_gpuMeshSliceVBOSizes[pass][slice];
 		}
-		if (!BlockDefintion::IsBlockTypeOpaque(blockIter.GetSouthNeighbour().GetBlock()->m_typeIndex))	//-y face
+	}
+
+	return gpuMeshBytes;
+}
+
+void Chunk::ReleaseCpuMesh()
+{
+	//the gpu copy and the vertex and quad counts stay
+	if (m_isMeshJobPending || m_isCpuMeshReleased)
+		return;
+
+	//last chance to write the slices the mesh cache file does not have yet, the loaded cache stays for the rebuild when a missing neighbour arrives
+	ChunkMeshCache* meshCache = TakeMeshCacheToSave();
+	if (meshCache)
+		m_world->QueueSaveJob(new ChunkSaveJob(m_chunkCoords, nullptr, "", nullptr, meshCache));
+
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
+	{
+		m_meshSlices[slice] = ChunkMeshData();
+	}
+	m_isCpuMeshReleased = true;
+}
+
+void Chunk::EvictMesh()
+{
+	if (m_isMeshJobPending || m_isMeshEvicted)
+		return;
+
+	m_evictedMeshBytes = GetGpuMeshBytes();
+	ReleaseCpuMesh();
+	DeleteGpuMesh();
+	m_loadedMeshCache.reset();
+	m_isMeshEvicted = true;
+}
+
+void Chunk::RestoreMesh()
+{
+	m_isMeshEvicted = false;
+	m_isMeshRestorePending = true;
+	SetChunkToDirty();
+}
+
+void Chunk::UploadMesh(uint32_t meshSlices)
+{
+	//slices that were not rebuilt keep their buffers as they are
+	bool isPacked = m_world->IsUsingPackedChunkVertices();
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
+	{
+		if ((meshSlices & (1u << slice)) == 0)
+			continue;
+
+		const ChunkMeshData& meshData = m_meshSlices[slice];
+		if (isPacked)
 		{
-			Rgba8 tileColor = GetFaceColor(blockIter.GetSouthNeighbour());
-			AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, near_topRight, near_bottomRight, far_bottomRight, far_topRight, tileColor, blockDef.m_sideUVs);
-			if (currentDugState > 0)
-			{
-				Vec3 offset = Vec3(0.f, -0.01f, 0.f);
-				AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, near_topRight + offset, near_bottomRight + offset,
-					far_bottomRight + offset, far_topRight + offset, tileColor, BlockDefintion::s_digCrackUVs[currentDugState - 1]);
-			}
+			UploadVertexData(CHUNK_MESH_PASS_OPAQUE, slice, meshData.m_opaquePackedVertices.data(), (int)meshData.m_opaquePackedVertices.size(), sizeof(ChunkVertex));
+			UploadVertexData(CHUNK_MESH_PASS_TRANSLUCENT, slice, meshData.m_translucentPackedVertices.data(), (int)meshData.m_translucentPackedVertices.size(), sizeof(ChunkVertex));
 		}
-		if (!BlockDefintion::IsBlockTypeOpaque(blockIter.GetEastNeighbour().GetBlock()->m_typeIndex))		//x face
+		else
 		{
-			Rgba8 tileColor = GetFaceColor(blockIter.GetEastNeighbour());
-			AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, far_topRight, far_bottomRight, far_bottomLeft, far_topLeft, tileColor, blockDef.m_sideUVs);
-			if (currentDugState > 0)
-			{
-				Vec3 offset = Vec3(0.01f, 0.f, 0.f);
-				AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, far_topRight + offset, far_bottomRight + offset,
-					far_bottomLeft + offset, far_topLeft + offset, tileColor, BlockDefintion::s_digCrackUVs[currentDugState - 1]);
-			}
+			UploadVertexData(CHUNK_MESH_PASS_OPAQUE, slice, meshData.m_opaqueVertices.data(), (int)meshData.m_opaqueVertices.size(), sizeof(Vertex_PCU));
+			UploadVertexData(CHUNK_MESH_PASS_TRANSLUCENT, slice, meshData.m_translucentVertices.data(), (int)meshData.m_translucentVertices.size(), sizeof(Vertex_PCU));
 		}
-		if (!BlockDefintion::IsBlockTypeOpaque(blockIter.GetNorthNeighbour().GetBlock()->m_typeIndex))		//y face
+	}
+
+	for (int pass = 0; pass < NUM_CHUNK_MESH_PASSES; pass++)
+	{
+		m_numGpuMeshQuads[pass] = 0;
+		for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
 		{
-			Rgba8 tileColor = GetFaceColor(blockIter.GetNorthNeighbour());
-			AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, far_topLeft, far_bottomLeft, near_bottomLeft, near_topLeft, tileColor, blockDef.m_sideUVs);
-			if (currentDugState > 0)
-			{
-				Vec3 offset = Vec3(0.f, 0.01f, 0.f);
-				AddVertsForQuad3D(m_cpuMeshOpaqueVertices, m_cpuMeshOpaqueIndicies, far_topLeft + offset, far_bottomLeft + offset,
-					near_bottomLeft + offset, near_topLeft + offset, tileColor, BlockDefintion::s_digCrackUVs[currentDugState - 1]);
-			}
+			m_numGpuMeshQuads[pass] += m_numGpuMeshSliceQuads[pass][slice];
 		}
 	}
+	m_numMeshVertices = (m_numGpuMeshQuads[CHUNK_MESH_PASS_OPAQUE] + m_numGpuMeshQuads[CHUNK_MESH_PASS_TRANSLUCENT]) * NUM_FACE_CORNERS;
+	m_world->AddToTotalNumberOfVerticesInChunks(m_numMeshVertices);
 }
 
-void Chunk::AddVertsForWaterBlock(const BlockDefintion& blockDef, const IntVec3& localCoords)
+void Chunk::UploadVertexData(ChunkMeshPass pass, int slice, const void* vertices, int numVertices, size_t stride)
 {
-	if (blockDef.m_visible)
+	//a slice that has become empty gives its buffer back instead of keeping the old mesh around
+	VertexBuffer*& vertexBuffer = m_gpuMeshSliceVBOs[pass][slice];
+	size_t& vertexBufferSize = m_gpuMeshSliceVBOSizes[pass][slice];
+	size_t size = stride * size_t(numVertices);
+	m_numGpuMeshSliceQuads[pass][slice] = numVertices / NUM_FACE_CORNERS;
+	if (size == 0)
 	{
-		Vec3 mins = m_worldBounds.m_mins + Vec3(localCoords);
-		AABB3 bounds = AABB3(mins, mins + Vec3::ONE);
-
-		Vec3 near_topLeft(bounds.m_mins.x, bounds.m_maxs.y, bounds.m_maxs.z);
-		Vec3 near_bottomLeft(bounds.m_mins.x, bounds.m_maxs.y, bounds.m_mins.z);
-		Vec3 near_bottomRight(bounds.m_mins.x, bounds.m_mins.y, bounds.m_mins.z);
-		Vec3 near_topRight(bounds.m_mins.x, bounds.m_mins.y, bounds.m_maxs.z);
-		Vec3 far_topLeft(bounds.m_maxs.x, bounds.m_maxs.y, bounds.m_maxs.z);
-		Vec3 far_bottomLeft(bounds.m_maxs.x, bounds.m_maxs.y, bounds.m_mins.z);
-		Vec3 far_bottomRight(bounds.m_maxs.x, bounds.m_mins.y, bounds.m_mins.z);
-		Vec3 far_topRight(bounds.m_maxs.x, bounds.m_mins.y, bounds.m_maxs.z);
-
-		BlockIterator blockIter = { this, GetBlockIndexFromLocalCoords(localCoords) };
-
-		//top face
-		Rgba8 tileColor = GetFaceColor(blockIter.GetAboveNeighbour());
-		//set face alpha to half
-		tileColor.a = 127;
-		//if this is the top most water block, set its blue channel to max to do vertex animations
-		if (localCoords.z == SEA_LEVEL)
-			tileColor.b = 255;
+		delete vertexBuffer;
+		vertexBuffer = nullptr;
+		vertexBufferSize = 0;
+		return;
+	}
 
-		AddVertsForQuad3D(m_cpuMeshTranslucentVertices, m_cpuMeshTranslucentIndicies, far_topLeft, near_topLeft, near_topRight, far_topRight, tileColor, blockDef.m_topUVs);
+	//the copy replaces the buffer's contents, so a mesh that has grown past the buffer needs a bigger one
+	size_t bufferSize = (stride == sizeof(ChunkVertex)) ? size + CHUNK_VERTEX_BUFFER_PADDING : size;
+	if (vertexBuffer && bufferSize > vertexBufferSize)
+	{
+		delete vertexBuffer;
+		vertexBuffer = nullptr;
+	}
+	if (!vertexBuffer)
+	{
+		vertexBuffer = g_theRenderer->CreateVertexBuffer(bufferSize, stride);
+		vertexBufferSize = bufferSize;
 	}
+	m_world->ReserveQuadIndices(m_numGpuMeshSliceQuads[pass][slice]);
+	g_theRenderer->CopyCPUToGPU(vertices, size, vertexBuffer);
 }
 
-bool Chunk::HasAllValidNeighbours() const
+void Chunk::DeleteGpuMesh()
 {
-	return m_northNeighbour && m_eastNeighbour && m_southNeighbour && m_westNeighbour;
+	for (int pass = 0; pass < NUM_CHUNK_MESH_PASSES; pass++)
+	{
+		for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
+		{
+			delete m_gpuMeshSliceVBOs[pass][slice];
+			m_gpuMeshSliceVBOs[pass][slice] = nullptr;
+			m_gpuMeshSliceVBOSizes[pass][slice] = 0;
+			m_numGpuMeshSliceQuads[pass][slice] = 0;
+		}
+		m_numGpuMeshQuads[pass] = 0;
+	}
 }
 
 bool Chunk::LoadBlocksFromFile()
 {
-	std::string filePath = Stringf("Saves/Chunk(%d,%d).chunk", m_chunkCoords.x, m_chunkCoords.y);
+	std::string filePath = GetSaveFilePath();
 	if (DoesFileExist(filePath))
 	{
 		std::vector<uint8_t> buffer;
 		FileReadToBuffer(buffer, filePath);
 		//check if file signature matches what we expect it to
-		if (buffer[0] == 'G' && buffer[1] == 'C' && buffer[2] == 'H' && buffer[3] == 'K' &&
-			buffer[4] == 1 && buffer[5] == CHUNK_BITS_X && buffer[6] == CHUNK_BITS_Y && buffer[7] == CHUNK_BITS_Z)
+		if (buffer.size() >= CHUNK_SAVE_HEADER_SIZE && buffer[0] == 'G' && buffer[1] == 'C' && buffer[2] == 'H' && buffer[3] == 'K' &&
+			(buffer[4] == 1 || buffer[4] == CHUNK_SAVE_VERSION) && buffer[5] == CHUNK_BITS_X && buffer[6] == CHUNK_BITS_Y && buffer[7] == CHUNK_BITS_Z)
 		{
+			//version 1 files are nothing but the blocks, version 2 ones say how many bytes the blocks take and may have the light after them
+			size_t blocksStart = CHUNK_SAVE_HEADER_SIZE;
+			size_t blocksEnd = buffer.size();
+			if (buffer[4] == CHUNK_SAVE_VERSION)
+			{
+				uint32_t numBlockBytes = 0;
+				if (buffer.size() >= CHUNK_SAVE_HEADER_SIZE + sizeof(numBlockBytes))
+					memcpy(&numBlockBytes, &buffer[CHUNK_SAVE_HEADER_SIZE], sizeof(numBlockBytes));
+				blocksStart += sizeof(numBlockBytes);
+				blocksEnd = blocksStart + numBlockBytes;
+				if (blocksEnd > buffer.size())
+				{
+					g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("Save file of chunk (%d, %d) is cut short, regenerating it", m_chunkCoords.x, m_chunkCoords.y));
+					return false;
+				}
+			}
+
 			int blockIndex = 0;
-			for (int i = 8; i < buffer.size(); i += 2)
+			for (size_t i = blocksStart; i + 1 < blocksEnd; i += 2)
 			{
 				uint8_t blockTypeIndex =  static_cast<int>(buffer[i]);
 				int numberOfBlocks = static_cast<int>(buffer[i + 1]);
-				for (int j = 0; j < numberOfBlocks; j++)
+				for (int j = 0; j < numberOfBlocks && blockIndex < CHUNK_TOTAL_BLOCKS; j++)
 				{
 					m_blocks[blockIndex].m_typeIndex = blockTypeIndex;
 					blockIndex++;
 				}
 			}
 			//GUARANTEE_OR_DIE(blockIndex == CHUNK_TOTAL_BLOCKS, "Total blocks wrong");
+
+			if (blocksEnd < buffer.size())
+				m_isLightLoaded = LoadLightFromBuffer(buffer, blocksEnd);
 			return true;
 		}
 		else
 		{
-			ERROR_AND_DIE(Stringf("Loaded file signature didnt not match for chunk (%d, %d)", m_chunkCoords.x, m_chunkCoords.y));
+			//saves written by a build with different chunk dimensions are regenerated instead of decoded
+			g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("Loaded file signature did not match for chunk (%d, %d), regenerating it", m_chunkCoords.x, m_chunkCoords.y));
 			return false;
 		}
 	}
@@ -673,27 +1110,69 @@ bool Chunk::LoadBlocksFromFile()
 	return false;
 }
 
-void Chunk::SaveBlockToFile()
+bool Chunk::LoadLightFromBuffer(const std::vector<uint8_t>& buffer, size_t readOffset)
 {
+	if (readOffset + CHUNK_SAVE_LIGHT_HEADER_SIZE > buffer.size())
+		return false;
+
+	//the light is only good for the exact blocks and block definitions it was worked out from
+	uint64_t lightInputHash = 0;
+	memcpy(&lightInputHash, &buffer[readOffset], sizeof(lightInputHash));
+	if (lightInputHash != ChunkLighting::ComputeLightInputHash(*m_blockData))
+		return false;
+	memcpy(m_loadedBorderLightHashes, &buffer[readOffset + sizeof(lightInputHash)], sizeof(m_loadedBorderLightHashes));
+	readOffset += CHUNK_SAVE_LIGHT_HEADER_SIZE;
+
+	int blockIndex = 0;
+	for (size_t i = readOffset; i + 1 < buffer.size(); i += 2)
+	{
+		uint8_t lightInfluence = buffer[i];
+		int numberOfBlocks = static_cast<int>(buffer[i + 1]);
+		for (int j = 0; j < numberOfBlocks && blockIndex < CHUNK_TOTAL_BLOCKS; j++)
+		{
+			m_blocks[blockIndex].m_lightInfluence = lightInfluence;
+			blockIndex++;
+		}
+	}
+	if (blockIndex != CHUNK_TOTAL_BLOCKS)
+		return false;
+
+	//sides saved without a neighbour have nothing to check, light from a neighbour that shows up later is merged in like for any other chunk
+	const uint8_t sides[4] = { CHUNK_SIDE_NORTH, CHUNK_SIDE_EAST, CHUNK_SIDE_SOUTH, CHUNK_SIDE_WEST };
+	m_unverifiedLightSides = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		if (m_loadedBorderLightHashes[i] != 0)
+			m_unverifiedLightSides |= sides[i];
+	}
+	return true;
+}
+
+void Chunk::SaveBlocksToFile(const ChunkBlockData& blockData, const std::string& filePath, const uint64_t* borderLightHashes)
+{
+	const Block* blocks = blockData.m_blocks;
 	std::vector<uint8_t> buffer;
-	buffer.reserve(CHUNK_SIZE_X * CHUNK_SIZE_Y * CHUNK_SIZE_Y);
+	buffer.reserve(CHUNK_BLOCKS_PER_LAYER * 2);
 	//write file signature
 	buffer.push_back('G');
 	buffer.push_back('C');
 	buffer.push_back('H');
 	buffer.push_back('K');
-	buffer.push_back(1);
+	buffer.push_back(CHUNK_SAVE_VERSION);
 	buffer.push_back(CHUNK_BITS_X);
 	buffer.push_back(CHUNK_BITS_Y);
 	buffer.push_back(CHUNK_BITS_Z);
+	//byte count of the block data, filled in once it is written
+	buffer.resize(buffer.size() + sizeof(uint32_t));
+	size_t blocksStart = buffer.size();
 
 	int totalBlockwritten = 0;
 	//write rest of the block data using run length encoding
 	for (int i = 0; i < CHUNK_TOTAL_BLOCKS - 1; )
 	{
-		uint8_t currentBlockType = m_blocks[i].m_typeIndex;
+		uint8_t currentBlockType = blocks[i].m_typeIndex;
 		uint8_t numberOfBlockOfSameTypeTogether = 0;
-		while (m_blocks[i + numberOfBlockOfSameTypeTogether].m_typeIndex == currentBlockType && 
+		while (blocks[i + numberOfBlockOfSameTypeTogether].m_typeIndex == currentBlockType && 
 			numberOfBlockOfSameTypeTogether < 255 && 
 			(i + numberOfBlockOfSameTypeTogether) < (CHUNK_TOTAL_BLOCKS - 1))
 		{
@@ -705,54 +1184,66 @@ void Chunk::SaveBlockToFile()
 		i += numberOfBlockOfSameTypeTogether;
 		totalBlockwritten = i;
 	}
+	uint32_t numBlockBytes = uint32_t(buffer.size() - blocksStart);
+	memcpy(&buffer[CHUNK_SAVE_HEADER_SIZE], &numBlockBytes, sizeof(numBlockBytes));
+
+	//the light goes after the blocks, keyed by what it was worked out from so a load can tell whether it still holds
+	if (borderLightHashes)
+	{
+		uint64_t lightInputHash = ChunkLighting::ComputeLightInputHash(blockData);
+		size_t lightStart = buffer.size();
+		buffer.resize(lightStart + CHUNK_SAVE_LIGHT_HEADER_SIZE);
+		memcpy(&buffer[lightStart], &lightInputHash, sizeof(lightInputHash));
+		memcpy(&buffer[lightStart + sizeof(lightInputHash)], borderLightHashes, 4 * sizeof(uint64_t));
+
+		for (int i = 0; i < CHUNK_TOTAL_BLOCKS; )
+		{
+			uint8_t lightInfluence = blocks[i].m_lightInfluence;
+			int runLength = 1;
+			while (i + runLength < CHUNK_TOTAL_BLOCKS && runLength < 255 && blocks[i + runLength].m_lightInfluence == lightInfluence)
+			{
+				runLength++;
+			}
+
+			buffer.push_back(lightInfluence);
+			buffer.push_back(uint8_t(runLength));
+			i += runLength;
+		}
+	}
 
-	std::string filePath = Stringf("Saves/Chunk(%d,%d).chunk", m_chunkCoords.x, m_chunkCoords.y);
 	BufferWriteToFile(buffer, filePath);
 }
 
-Rgba8 Chunk::GetFaceColor(const BlockIterator& blockIterator)
+std::string Chunk::GetSaveFilePath() const
 {
-	Rgba8 color;
-	Block& block = *blockIterator.GetBlock();
-	color.r = unsigned char(RangeMap(block.GetOutdoorLightInfluence(), 0.f, 15.f, 0.f, 255.f));
-	color.g = unsigned char(RangeMap(block.GetIndoorLightInfluence(), 0.f, 15.f, 0.f, 255.f));
-	color.b = 0;
-	color.a = 255;
-	return color;
+	//the default 16x16x128 chunks keep the original file names, other variants get their own files so they do not overwrite each other
+	if (CHUNK_BITS_X == 4 && CHUNK_BITS_Y == 4 && CHUNK_BITS_Z == 7)
+		return Stringf("Saves/Chunk(%d,%d).chunk", m_chunkCoords.x, m_chunkCoords.y);
+
+	return Stringf("Saves/Chunk(%d,%d)_%dx%dx%d.chunk", m_chunkCoords.x, m_chunkCoords.y, CHUNK_SIZE_X, CHUNK_SIZE_Y, CHUNK_SIZE_Z);
 }
 
-void Chunk::ProcessLightingForDugBlock(const BlockIterator& blockIter)
+std::string Chunk::GetMeshCacheFilePath() const
 {
-	m_world->MarkLightingDirty(blockIter);
+	if (CHUNK_BITS_X == 4 && CHUNK_BITS_Y == 4 && CHUNK_BITS_Z == 7)
+		return Stringf("Saves/Chunk(%d,%d).mesh", m_chunkCoords.x, m_chunkCoords.y);
 
-	IntVec3 localCoords = GetLocalCoordsFromBlockIndex(blockIter.m_blockIndex);
-	bool isSkyBlock = blockIter.GetAboveNeighbour().GetBlock()->IsBlockSky();
-	if (isSkyBlock)
-	{
-		BlockIterator neighbour = blockIter;
-		while (!BlockDefintion::IsBlockTypeOpaque(neighbour.GetBlock()->m_typeIndex))
-		{
-			neighbour.GetBlock()->SetIsBlockSky(true);
-			m_world->MarkLightingDirty(neighbour);
-			neighbour = neighbour.GetBelowNeighbour();
-		}
-	}
+	return Stringf("Saves/Chunk(%d,%d)_%dx%dx%d.mesh", m_chunkCoords.x, m_chunkCoords.y, CHUNK_SIZE_X, CHUNK_SIZE_Y, CHUNK_SIZE_Z);
 }
 
-void Chunk::ProcessLightingForAddedBlock(const BlockIterator& blockIter)
+void Chunk::ProcessLightingForEditedBlock(const BlockIterator& blockIter, int previousHighestOpaqueZ)
 {
-	Block* block = blockIter.GetBlock();
 	m_world->MarkLightingDirty(blockIter);
-	if (block->IsBlockSky() && BlockDefintion::IsBlockTypeOpaque(block->m_typeIndex))
+
+	//the blocks between the column's old and new highest opaque block are the only ones that gain or lose the sky, the column height already says which
+	int columnIndex = blockIter.m_blockIndex & (CHUNK_MASK_X | CHUNK_MASK_Y);
+	int highestOpaqueZ = m_blockData->m_highestOpaqueZ[columnIndex];
+	int minZ = std::min(highestOpaqueZ, previousHighestOpaqueZ) + 1;
+	int maxZ = std::max(highestOpaqueZ, previousHighestOpaqueZ);
+	for (int z = minZ; z <= maxZ; z++)
 	{
-		block->SetIsBlockSky(false);
-		BlockIterator neighbour = blockIter.GetBelowNeighbour();
-		while (!BlockDefintion::IsBlockTypeOpaque(neighbour.GetBlock()->m_typeIndex))
-		{
-			neighbour.GetBlock()->SetIsBlockSky(false);
-			m_world->MarkLightingDirty(neighbour);
-			neighbour = neighbour.GetBelowNeighbour();
-		}
+		int blockIndex = columnIndex | (z << (CHUNK_BITS_X + CHUNK_BITS_Y));
+		m_world->MarkLightingDirty({ this, blockIndex });
 	}
 }
 
@@ -811,12 +1302,61 @@ void Chunk::AddBlocksForTree(const std::string& treeName, const IntVec3& baseCoo
 		}
 
 		if(blockIter.GetBlock())
-			blockIter.GetBlock()->m_typeIndex = treeTemplate.m_blockTemplateEntries[i].m_blockTypeIndex;
+			blockIter.GetBlockForWrite()->m_typeIndex = treeTemplate.m_blockTemplateEntries[i].m_blockTypeIndex;
 	}
 }
 
+void ChunkBlockData::ComputeColumnHeights()
+{
+	uint8_t airTypeIndex = BlockDefintion::GetDefinitionIndexByName("air");
+	for (int columnIndex = 0; columnIndex < CHUNK_BLOCKS_PER_LAYER; columnIndex++)
+	{
+		m_highestOpaqueZ[columnIndex] = FindHighestZInColumn(columnIndex, CHUNK_MAX_Z, true, airTypeIndex);
+		m_highestNonAirZ[columnIndex] = FindHighestZInColumn(columnIndex, CHUNK_MAX_Z, false, airTypeIndex);
+	}
+}
+
+void ChunkBlockData::UpdateColumnHeightsForBlock(int blockIndex)
+{
+	//raising a column is O(1), only taking away its top block looks further down, which is usually a block or two
+	int columnIndex = blockIndex & (CHUNK_MASK_X | CHUNK_MASK_Y);
+	int z = blockIndex >> (CHUNK_BITS_X + CHUNK_BITS_Y);
+	uint8_t typeIndex = m_blocks[blockIndex].m_typeIndex;
+	uint8_t airTypeIndex = BlockDefintion::GetDefinitionIndexByName("air");
+	if (BlockDefintion::IsBlockTypeOpaque(typeIndex))
+	{
+		if (z > m_highestOpaqueZ[columnIndex])
+			m_highestOpaqueZ[columnIndex] = int16_t(z);
+	}
+	else if (z == m_highestOpaqueZ[columnIndex])
+	{
+		m_highestOpaqueZ[columnIndex] = FindHighestZInColumn(columnIndex, z - 1, true, airTypeIndex);
+	}
+
+	if (typeIndex != airTypeIndex)
+	{
+		if (z > m_highestNonAirZ[columnIndex])
+			m_highestNonAirZ[columnIndex] = int16_t(z);
+	}
+	else if (z == m_highestNonAirZ[columnIndex])
+	{
+		m_highestNonAirZ[columnIndex] = FindHighestZInColumn(columnIndex, z - 1, false, airTypeIndex);
+	}
+}
+
+int16_t ChunkBlockData::FindHighestZInColumn(int columnIndex, int startZ, bool opaqueOnly, uint8_t airTypeIndex) const
+{
+	for (int z = startZ; z >= 0; z--)
+	{
+		uint8_t typeIndex = m_blocks[columnIndex | (z << (CHUNK_BITS_X + CHUNK_BITS_Y))].m_typeIndex;
+		if (opaqueOnly ? BlockDefintion::IsBlockTypeOpaque(typeIndex) : typeIndex != airTypeIndex)
+			return int16_t(z);
+	}
+	return -1;
+}
+
 ChunkGenerationJob::ChunkGenerationJob(Chunk* chunk)
-	:m_chunk(chunk)
+	:m_chunk(chunk), m_chunkHandle(chunk->GetHandle())
 {
 }
 
@@ -824,9 +1364,38 @@ void ChunkGenerationJob::Execute()
 {
 	m_chunk->m_status = ACTIVATING_GENERATING;
 	m_chunk->InitializeBlocks();
+	m_chunk->InitializeLighting();
 }
 
 void ChunkGenerationJob::OnFinished()
 {
 	m_chunk->m_status = ACTIVATING_GENERATE_COMPLETE;
 }
+
+ChunkSaveJob::ChunkSaveJob(const IntVec2& chunkCoords, const ChunkSnapshot& snapshot, const std::string& filePath, const uint64_t* borderLightHashes, ChunkMeshCache* meshCache)
+	:m_chunkCoords(chunkCoords), m_snapshot(snapshot), m_filePath(filePath), m_meshCache(meshCache)
+{
+	if (meshCache)
+		m_meshCacheBytes = meshCache->GetMemoryBytes();
+	if (borderLightHashes)
+	{
+		m_saveLight = true;
+		memcpy(m_borderLightHashes, borderLightHashes, sizeof(m_borderLightHashes));
+	}
+}
+
+ChunkSaveJob::~ChunkSaveJob()
+{
+	delete m_meshCache;
+	m_meshCache = nullptr;
+}
+
+void ChunkSaveJob::Execute()
+{
+	double startTime = GetCurrentTimeSeconds();
+	if (m_snapshot)
+		Chunk::SaveBlocksToFile(*m_snapshot, m_filePath, m_saveLight ? m_borderLightHashes : nullptr);
+	if (m_meshCache)
+		m_meshCache->SaveToFile();
+	m_saveTimeMs = float((GetCurrentTimeSeconds() - startTime) * 1000.0);
+}
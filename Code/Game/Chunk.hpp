@@ -1,18 +1,42 @@
 #pragma once
+#include <unordered_map>
+#include <vector>
+#include <deque>
+#include <memory>
 #include "Engine/Math/AABB3.hpp"
 #include "Engine/Core/Vertex_PCU.hpp"
 #include "Engine/Core/Job.hpp"
 #include "Game/Block.hpp"
+#include "Game/ChunkHandle.hpp"
+#include "Game/ChunkVertex.hpp"
 
 class World;
-class VertexBuffer;
-class IndexBuffer;
 struct IntVec3;
 struct BlockIterator;
+class ChunkMeshJob;
+struct ChunkMeshData;
+class ChunkMeshCache;
+class VertexBuffer;
+
+//chunk dimensions are a build setting, define CHUNK_BITS_X_SETTING, CHUNK_BITS_Y_SETTING and CHUNK_BITS_Z_SETTING
+//in the project's preprocessor definitions to build a different variant (e.g. 5/5/7 for 32x32x128 or 4/4/8 for 16x16x256)
+#ifndef CHUNK_BITS_X_SETTING
+#define CHUNK_BITS_X_SETTING 4
+#endif
+#ifndef CHUNK_BITS_Y_SETTING
+#define CHUNK_BITS_Y_SETTING 4
+#endif
+#ifndef CHUNK_BITS_Z_SETTING
+#define CHUNK_BITS_Z_SETTING 7
+#endif
 
-constexpr int CHUNK_BITS_X = 4;
-constexpr int CHUNK_BITS_Y = 4;
-constexpr int CHUNK_BITS_Z = 7;
+constexpr int CHUNK_BITS_X = CHUNK_BITS_X_SETTING;
+constexpr int CHUNK_BITS_Y = CHUNK_BITS_Y_SETTING;
+constexpr int CHUNK_BITS_Z = CHUNK_BITS_Z_SETTING;
+static_assert(CHUNK_BITS_X >= 2 && CHUNK_BITS_Y >= 2, "Chunks need to be at least 4 blocks wide");
+static_assert(CHUNK_BITS_Z >= 6, "World generation needs chunks to be at least 64 blocks tall");
+static_assert(CHUNK_BITS_X + CHUNK_BITS_Y + CHUNK_BITS_Z <= 24, "Block index does not fit in 24 bits");
+static_assert(CHUNK_BITS_Z <= 15, "Column heights are kept in 16 bits");
 
 constexpr int CHUNK_SIZE_X = 1 << CHUNK_BITS_X;
 constexpr int CHUNK_SIZE_Y = 1 << CHUNK_BITS_Y;
@@ -25,6 +49,42 @@ constexpr int CHUNK_MAX_Z = CHUNK_SIZE_Z - 1;
 constexpr int CHUNK_TOTAL_BLOCKS = CHUNK_SIZE_X * CHUNK_SIZE_Y * CHUNK_SIZE_Z;
 constexpr int CHUNK_BLOCKS_PER_LAYER = CHUNK_SIZE_X * CHUNK_SIZE_Y;
 
+//block index steps and masks, used to move between neighbouring blocks without unpacking the block index
+constexpr int CHUNK_STEP_X = 1;
+constexpr int CHUNK_STEP_Y = 1 << CHUNK_BITS_X;
+constexpr int CHUNK_STEP_Z = 1 << (CHUNK_BITS_X + CHUNK_BITS_Y);
+constexpr int CHUNK_MASK_X = CHUNK_MAX_X;
+constexpr int CHUNK_MASK_Y = CHUNK_MAX_Y << CHUNK_BITS_X;
+constexpr int CHUNK_MASK_Z = CHUNK_MAX_Z << (CHUNK_BITS_X + CHUNK_BITS_Y);
+
+//bits for the four sides of a chunk
+constexpr uint8_t CHUNK_SIDE_NORTH = 0x01;
+constexpr uint8_t CHUNK_SIDE_EAST = 0x02;
+constexpr uint8_t CHUNK_SIDE_SOUTH = 0x04;
+constexpr uint8_t CHUNK_SIDE_WEST = 0x08;
+
+//fnv-1a, used to key data kept on disk by what it was built from
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+//height of the sea surface, shared by world generation and the water mesh
+constexpr int SEA_LEVEL = CHUNK_SIZE_Z / 2;
+
+//chunk meshes are built in vertical slices of whole layers, so an edit only rebuilds the slices it touches
+constexpr int CHUNK_MESH_SLICE_BITS = CHUNK_BITS_Z > 8 ? CHUNK_BITS_Z - 4 : 4;
+constexpr int CHUNK_MESH_SLICE_HEIGHT = 1 << CHUNK_MESH_SLICE_BITS;
+constexpr int CHUNK_NUM_MESH_SLICES = CHUNK_SIZE_Z >> CHUNK_MESH_SLICE_BITS;
+constexpr uint32_t ALL_CHUNK_MESH_SLICES = uint32_t((1ull << CHUNK_NUM_MESH_SLICES) - 1);
+static_assert(CHUNK_NUM_MESH_SLICES <= 32, "Dirty mesh slices are tracked in a 32 bit mask");
+
+//opaque meshes of every chunk are drawn before the translucent ones, which blend over them
+enum ChunkMeshPass
+{
+	CHUNK_MESH_PASS_OPAQUE,
+	CHUNK_MESH_PASS_TRANSLUCENT,
+	NUM_CHUNK_MESH_PASSES
+};
+
 enum ChunkState
 {
 	MISSING,							//chunk not present yet
@@ -35,30 +95,114 @@ enum ChunkState
 	//DEACTIVATING						//chunk is being destroyed by main thread
 };
 
+//block data of a chunk, shared between the chunk and any snapshots taken of it
+struct ChunkBlockData
+{
+public:
+	Block m_blocks[CHUNK_TOTAL_BLOCKS];
+	std::unordered_map<int, BlockMetadata> m_blockMetadata;	//sparse, keyed by block index, only blocks with non default metadata have an entry
+	uint32_t m_version = 0;
+	//per column (block index of its bottom block), the z of the highest opaque and the highest non air block, -1 for columns without one
+	int16_t m_highestOpaqueZ[CHUNK_BLOCKS_PER_LAYER] = {};
+	int16_t m_highestNonAirZ[CHUNK_BLOCKS_PER_LAYER] = {};
+
+public:
+	void ComputeColumnHeights();
+	//keeps the column heights right after the block at blockIndex changed type
+	void UpdateColumnHeightsForBlock(int blockIndex);
+
+private:
+	int16_t FindHighestZInColumn(int columnIndex, int startZ, bool opaqueOnly, uint8_t airTypeIndex) const;
+};
+
+//an immutable view of a chunk's block data at some version, safe to read from worker threads while the main thread keeps editing the chunk
+typedef std::shared_ptr<const ChunkBlockData> ChunkSnapshot;
+
+//block waiting in one of a chunk's light propagation queues
+struct LightQueueEntry
+{
+public:
+	int m_blockIndex = 0;
+	LightChannel m_channel = LIGHT_CHANNEL_OUTDOOR;
+	uint8_t m_level = 0;
+};
+
+class ChunkSaveJob;
+
 class Chunk
 {
 public:
 	Chunk(World* world, const IntVec2& chunkCoordinates);
 	~Chunk();
 	void Update(float deltaSeconds);
-	void Render() const;
+	void Render(ChunkMeshPass pass) const;
 	const IntVec2& GetChunkCoordinates() const { return m_chunkCoords; }
+	ChunkHandle GetHandle() const { return m_handle; }
+	void SetHandle(const ChunkHandle& handle) { m_handle = handle; }
 	const AABB3& GetChunkWorldBounds() const { return m_worldBounds; }
-	int GetChunkMeshVertices() const { return (int)m_cpuMeshOpaqueVertices.size(); }
+	int GetChunkMeshVertices() const { return m_numMeshVertices; }
 	IntVec3 GetLocalCoordsFromBlockIndex(int blockIndex) const;
 	int GetZHeightOfHighestNonAirBlock(int columnX, int columnY) const;
+	int GetZHeightOfHighestOpaqueBlock(int columnX, int columnY) const;
 	void DigBlock(const BlockIterator& blockIter);
 	void AddBlock(const BlockIterator& blockIter);
 	void SetChunkToDirty();
-	Block* GetBlock(int blockIndex) const;
+	void SetMeshDirtyForBlock(int blockIndex);
+	void SetMeshDirtyForLightChange(int blockIndex);
+	void MarkLightingDirty(int blockIndex);
+	//blocks above the highest opaque block of their column see the sky
+	bool IsBlockSky(int blockIndex) const { return (blockIndex >> (CHUNK_BITS_X + CHUNK_BITS_Y)) > m_blockData->m_highestOpaqueZ[blockIndex & (CHUNK_BLOCKS_PER_LAYER - 1)]; }
+	void QueueLightIncrease(int blockIndex, LightChannel channel, uint8_t level);
+	void QueueLightDecrease(int blockIndex, LightChannel channel, uint8_t level);
+	bool HasDirtyLighting() const { return !m_dirtyLightBlocks.empty() || !m_lightDecreaseQueue.empty() || !m_lightIncreaseQueue.empty(); }
+	bool PopDirtyLightBlock(int& out_blockIndex);
+	bool PopLightDecrease(LightQueueEntry& out_entry);
+	bool PopLightIncrease(LightQueueEntry& out_entry);
+	const std::deque<int>& GetDirtyLightBlocks() const { return m_dirtyLightBlocks; }
+	bool IsLightingSettled() const;
+	void OnLightingSettled();
+	void QueueMeshRebuildIfDirty();
+	void OnRemovedFromMeshRebuildQueue();
+	void OnNeighbourActivated(const Chunk& neighbour);
+	const Block* GetBlock(int blockIndex) const;
+	Block* GetBlockForWrite(int blockIndex);		//detaches block data shared with a snapshot, only for callers that change the block
+	const BlockMetadata* GetBlockMetadata(int blockIndex) const;
+	BlockMetadata& GetOrCreateBlockMetadata(int blockIndex);
+	void ClearBlockMetadata(int blockIndex);
+	uint8_t GetBlockDigState(int blockIndex) const;
 	void InitializeLighting();
+	void MergeBorderLighting();
 	void InitializeBlocks();
-	void GenerateGeometry();
+	ChunkMeshJob* CreateMeshJob();
+	void OnMeshJobFinished(ChunkMeshJob& meshJob);
+	ChunkMeshCache* TakeMeshCacheToSave();
 	bool ShouldRebuildMesh() const;
+	bool IsMeshJobPending() const { return m_isMeshJobPending; }
+	size_t GetCpuMeshBytes() const;
+	size_t GetGpuMeshBytes() const;
+	void ReleaseCpuMesh();
+	void EvictMesh();
+	void RestoreMesh();
+	bool IsMeshEvicted() const { return m_isMeshEvicted; }
+	size_t GetEvictedMeshBytes() const { return m_evictedMeshBytes; }
+	ChunkSnapshot TakeSnapshot();
+	uint32_t GetBlockDataVersion() const { return m_blockData->m_version; }
+	void MarkBlockDataChanged();
+	bool NeedsSaving() const { return m_needsSaving; }
+	bool HasUnsavedMeshCache() const { return m_hasUnsavedMeshSlices && !m_isCpuMeshReleased; }
+	//null when there is nothing to save, the blocks when they changed and the mesh cache when it has unsaved slices, which are taken from the cpu mesh
+	ChunkSaveJob* CreateSaveJob();
+	void SaveBlocksIfNeeded();
+	void SaveMeshCacheIfNeeded();
+	std::string GetSaveFilePath() const;
+	std::string GetMeshCacheFilePath() const;
 
 	static IntVec2 GetChunkCoordinatedForWorldPosition(const Vec3& position);
 	static Vec2 GetChunkCenterXYForGlobalChunkCoords(const IntVec2& chunkCoords);
 	static int GetBlockIndexFromLocalCoords(const IntVec3& localCoords);
+	static uint32_t GetMeshSlicesTouchingBlock(int blockIndex);
+	//border light hashes are those of the north, east, south and west neighbours' borders the light was worked out with, nullptr saves no light
+	static void SaveBlocksToFile(const ChunkBlockData& blockData, const std::string& filePath, const uint64_t* borderLightHashes);
 
 public:
 	std::atomic<ChunkState> m_status = MISSING;
@@ -69,30 +213,56 @@ public:
 
 private:
 	World* m_world = nullptr;
+	ChunkHandle m_handle;
 	IntVec2 m_chunkCoords = IntVec2::ZERO;
 	AABB3 m_worldBounds = AABB3::ZERO_TO_ONE;
-	bool m_isChunkDirty = true;
+	uint32_t m_dirtyMeshSlices = ALL_CHUNK_MESH_SLICES;		//bit per mesh slice that needs rebuilding
+	bool m_isMeshJobPending = false;
+	bool m_isQueuedForMeshRebuild = false;		//has an entry in the world's mesh rebuild queue, so dirtying it again does not add another
+	uint8_t m_provisionalMeshSides = 0;		//CHUNK_SIDE_ bits of the sides meshed without their neighbour, as if it were solid
 	bool m_needsSaving = false;
-	Block* m_blocks = nullptr;
-	VertexBuffer* m_gpuMeshOpaqueVBO = nullptr;
-	IndexBuffer* m_gpuMeshOpaqueIBO = nullptr;
-	VertexBuffer* m_gpuMeshTranslucentVBO = nullptr;
-	IndexBuffer* m_gpuMeshTranslucentIBO = nullptr;
-	std::vector<Vertex_PCU> m_cpuMeshOpaqueVertices;
-	std::vector<unsigned int> m_cpuMeshOpaqueIndicies;
-	std::vector<Vertex_PCU> m_cpuMeshTranslucentVertices;
-	std::vector<unsigned int> m_cpuMeshTranslucentIndicies;
+	std::deque<int> m_dirtyLightBlocks;		//block indices whose light sources changed, the world checks their light against their neighbours
+	std::vector<uint64_t> m_dirtyLightBlockBits;		//bit per block in m_dirtyLightBlocks so none is queued twice, only allocated while there are any
+	std::deque<LightQueueEntry> m_lightDecreaseQueue;		//blocks darkened to 0, with the level they had, their neighbours lit by them follow
+	std::deque<LightQueueEntry> m_lightIncreaseQueue;		//blocks whose light spreads on to their neighbours, with the level it spreads from
+	uint32_t m_lightChangedMeshSlices = 0;		//slices whose light changed, they are marked dirty once the light around the chunk has settled
+	bool m_isQueuedForLighting = false;		//in the world's list of chunks with light work, mesh rebuilds wait until it is taken off
+	bool m_isLightLoaded = false;		//the light came from the save file, so the generation job does not work it out again
+	uint8_t m_unverifiedLightSides = 0;		//CHUNK_SIDE_ bits of the sides whose neighbour has not been checked against the loaded light yet
+	uint64_t m_loadedBorderLightHashes[4] = {};		//north, east, south and west neighbour border hashes saved with the light, 0 for sides saved without a neighbour
+	std::shared_ptr<ChunkBlockData> m_blockData;
+	Block* m_blocks = nullptr;			//points into m_blockData
+	bool m_isBlockDataShared = false;	//a snapshot may still reference m_blockData, copy it before writing
+	VertexBuffer* m_gpuMeshSliceVBOs[NUM_CHUNK_MESH_PASSES][CHUNK_NUM_MESH_SLICES] = {};		//one per slice so a rebuilt slice only replaces its own, null while it has nothing to draw
+	size_t m_gpuMeshSliceVBOSizes[NUM_CHUNK_MESH_PASSES][CHUNK_NUM_MESH_SLICES] = {};		//bytes each buffer was created with, a bigger mesh needs a new buffer
+	int m_numGpuMeshSliceQuads[NUM_CHUNK_MESH_PASSES][CHUNK_NUM_MESH_SLICES] = {};
+	int m_numGpuMeshQuads[NUM_CHUNK_MESH_PASSES] = {};		//of all slices together
+	ChunkMeshData* m_meshSlices = nullptr;		//cpu mesh of each of the CHUNK_NUM_MESH_SLICES slices, each uploaded to its own gpu buffers
+	int m_numMeshVertices = 0;
+	bool m_isCpuMeshReleased = false;		//m_meshSlices were dropped after upload, the next mesh job rebuilds every slice
+	bool m_isMeshEvicted = false;			//nothing of the mesh is in memory until the residency manager restores it
+	bool m_isMeshRestorePending = false;
+	size_t m_evictedMeshBytes = 0;
+	uint64_t m_meshSliceKeys[CHUNK_NUM_MESH_SLICES] = {};		//mesh cache key of each slice in m_meshSlices
+	bool m_hasUnsavedMeshSlices = false;		//slices were built since the mesh cache file was last written, they are written when the cpu mesh goes
+	bool m_hasReadMeshCacheFile = false;
+	std::shared_ptr<const ChunkMeshCache> m_loadedMeshCache;		//the mesh cache file as the first mesh job read it, dropped once a mesh is built with all four neighbours
 
 private:
-	void AddVertsForBlock(const BlockDefintion& blockDef, const IntVec3& localCoords);
-	void AddVertsForWaterBlock(const BlockDefintion& blockDef, const IntVec3& localCoords);
+	void UploadMesh(uint32_t meshSlices);
+	void UploadVertexData(ChunkMeshPass pass, int slice, const void* vertices, int numVertices, size_t stride);
+	void DeleteGpuMesh();
 	//bool IsBlockAtLocalCoordsOpaque(const IntVec3& localCoords);
-	bool HasAllValidNeighbours() const;
+	void SetMeshDirtyForEditedBlock(const BlockIterator& blockIter);
+	void MarkMeshSlicesDirty(uint32_t slices);
+	void QueueForLighting();
 	bool LoadBlocksFromFile();
-	void SaveBlockToFile();
-	Rgba8 GetFaceColor(const BlockIterator& blockIterator);
-	void ProcessLightingForDugBlock(const BlockIterator& blockIter);
-	void ProcessLightingForAddedBlock(const BlockIterator& blockIter);
+	bool LoadLightFromBuffer(const std::vector<uint8_t>& buffer, size_t readOffset);
+	bool GetBorderLightHashesForSave(uint64_t* out_borderLightHashes) const;
+	uint64_t ComputeBorderLightHash(uint8_t side) const;
+	void VerifyLoadedBorderLight(uint8_t side, const Chunk& neighbour);
+	void DetachSharedBlockData();
+	void ProcessLightingForEditedBlock(const BlockIterator& blockIter, int previousHighestOpaqueZ);
 	bool IsLocalMaximaIn5x5(float refTreeNoise, IntVec2 globalCoordsXY);
 	void AddBlocksForTree(const std::string& treeName, const IntVec3& baseCoords);
 };
@@ -103,9 +273,31 @@ public:
 	ChunkGenerationJob(Chunk* chunk);
 
 public:
-	Chunk* m_chunk = nullptr;
+	Chunk* m_chunk = nullptr;		//owned by the job while it is generating, the world only uses it once m_chunkHandle still resolves to it
+	ChunkHandle m_chunkHandle;
 
 private:
 	virtual void Execute() override;
 	virtual void OnFinished() override;
+};
+
+class ChunkSaveJob : public Job
+{
+public:
+	//a null snapshot only writes the mesh cache, the job owns the mesh cache
+	ChunkSaveJob(const IntVec2& chunkCoords, const ChunkSnapshot& snapshot, const std::string& filePath, const uint64_t* borderLightHashes, ChunkMeshCache* meshCache);
+	~ChunkSaveJob();
+
+public:
+	IntVec2 m_chunkCoords = IntVec2::ZERO;
+	ChunkSnapshot m_snapshot;
+	std::string m_filePath;
+	ChunkMeshCache* m_meshCache = nullptr;
+	size_t m_meshCacheBytes = 0;		//counted against the mesh budget until the job is retrieved
+	bool m_saveLight = false;
+	uint64_t m_borderLightHashes[4] = {};
+	float m_saveTimeMs = 0.f;
+
+private:
+	virtual void Execute() override;
 };
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+
+//refers to a chunk through the world's chunk slot table instead of a raw pointer
+//the generation is bumped every time a slot is released, so a handle to a chunk that has been deactivated fails to resolve instead of dangling
+struct ChunkHandle
+{
+public:
+	static constexpr uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+	uint32_t m_index = INVALID_INDEX;
+	uint32_t m_generation = 0;
+
+public:
+	bool IsValid() const { return m_index != INVALID_INDEX; }
+	bool operator==(const ChunkHandle& other) const { return m_index == other.m_index && m_generation == other.m_generation; }
+	bool operator!=(const ChunkHandle& other) const { return !(*this == other); }
+};
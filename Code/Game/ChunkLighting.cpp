@@ -0,0 +1,174 @@
+#include <emmintrin.h>
+#include <vector>
+#include "Game/ChunkLighting.hpp"
+
+//the light planes have an empty layer below and above the chunk, so vertical neighbours never need a check
+constexpr int LIGHT_PLANE_PADDING = CHUNK_STEP_Z;
+constexpr int LIGHT_PLANE_SIZE = CHUNK_TOTAL_BLOCKS + 2 * LIGHT_PLANE_PADDING;
+
+//horizontal directions of the edge masks, each CHUNK_BLOCKS_PER_LAYER bytes
+enum LayerEdge
+{
+	LAYER_EDGE_WEST,
+	LAYER_EDGE_EAST,
+	LAYER_EDGE_SOUTH,
+	LAYER_EDGE_NORTH,
+	NUM_LAYER_EDGES
+};
+
+void ChunkLighting::ComputeLocalLighting(ChunkBlockData& blockData)
+{
+	static_assert(CHUNK_BLOCKS_PER_LAYER % 16 == 0, "Layers are lit 16 blocks at a time");
+	Block* blocks = blockData.m_blocks;
+
+	//per type lookups, 0xFF for true so they can be used directly as simd masks
+	uint8_t isTransparentByType[256] = {};
+	uint8_t emissionByType[256] = {};
+	for (int typeIndex = 0; typeIndex < (int)BlockDefintion::s_definitions.size(); typeIndex++)
+	{
+		isTransparentByType[typeIndex] = BlockDefintion::IsBlockTypeOpaque(typeIndex) ? 0 : 0xFF;
+		emissionByType[typeIndex] = BlockDefintion::s_definitions[typeIndex].m_indoorLightInfluence;
+	}
+
+	//one byte per block and channel instead of the packed nibbles, so both channels go through the same byte wise operations
+	std::vector<uint8_t> isTransparent(LIGHT_PLANE_SIZE, 0);
+	std::vector<uint8_t> outdoorLight(LIGHT_PLANE_SIZE, 0);
+	std::vector<uint8_t> indoorLight(LIGHT_PLANE_SIZE, 0);
+	for (int blockIndex = 0; blockIndex < CHUNK_TOTAL_BLOCKS; blockIndex++)
+	{
+		uint8_t typeIndex = blocks[blockIndex].m_typeIndex;
+		isTransparent[LIGHT_PLANE_PADDING + blockIndex] = isTransparentByType[typeIndex];
+		indoorLight[LIGHT_PLANE_PADDING + blockIndex] = emissionByType[typeIndex];
+	}
+
+	//0xFF where the block has a neighbour inside the layer in that direction, loads that run past a row's ends pick up blocks from other rows and are masked out
+	std::vector<uint8_t> hasNeighbourMasks(NUM_LAYER_EDGES * CHUNK_BLOCKS_PER_LAYER);
+	for (int columnIndex = 0; columnIndex < CHUNK_BLOCKS_PER_LAYER; columnIndex++)
+	{
+		int x = columnIndex & CHUNK_MASK_X;
+		int y = (columnIndex & CHUNK_MASK_Y) >> CHUNK_BITS_X;
+		hasNeighbourMasks[LAYER_EDGE_WEST * CHUNK_BLOCKS_PER_LAYER + columnIndex] = x > 0 ? 0xFF : 0;
+		hasNeighbourMasks[LAYER_EDGE_EAST * CHUNK_BLOCKS_PER_LAYER + columnIndex] = x < CHUNK_MAX_X ? 0xFF : 0;
+		hasNeighbourMasks[LAYER_EDGE_SOUTH * CHUNK_BLOCKS_PER_LAYER + columnIndex] = y > 0 ? 0xFF : 0;
+		hasNeighbourMasks[LAYER_EDGE_NORTH * CHUNK_BLOCKS_PER_LAYER + columnIndex] = y < CHUNK_MAX_Y ? 0xFF : 0;
+	}
+
+	//sky light comes straight down from the top layer, a block sees the sky when it is not opaque and the block above it sees the sky
+	const __m128i fullLight = _mm_set1_epi8(15);
+	const __m128i allSet = _mm_set1_epi8(char(0xFF));
+	for (int z = CHUNK_MAX_Z; z >= 0; z--)
+	{
+		for (int columnIndex = 0; columnIndex < CHUNK_BLOCKS_PER_LAYER; columnIndex += 16)
+		{
+			int planeIndex = LIGHT_PLANE_PADDING + (z << (CHUNK_BITS_X + CHUNK_BITS_Y)) + columnIndex;
+			__m128i aboveSeesSky = (z == CHUNK_MAX_Z) ? allSet : _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&outdoorLight[planeIndex + CHUNK_STEP_Z])), fullLight);
+			__m128i seesSky = _mm_and_si128(aboveSeesSky, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&isTransparent[planeIndex])));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&outdoorLight[planeIndex]), _mm_and_si128(seesSky, fullLight));
+		}
+	}
+
+	//light only ever goes up from the sources, so repeating the spread until no layer changes ends on the same light a flood fill would give
+	//a layer is only spread again while it or a layer next to it changed, most of the chunk is settled after the first pass
+	bool isLayerActive[CHUNK_SIZE_Z];
+	for (int z = 0; z < CHUNK_SIZE_Z; z++)
+	{
+		isLayerActive[z] = true;
+	}
+
+	bool anyLayerChanged = true;
+	for (int pass = 0; anyLayerChanged; pass++)
+	{
+		anyLayerChanged = false;
+		bool hasLayerChanged[CHUNK_SIZE_Z] = {};
+		//walking the layers down and up in turns carries light through a whole column in one pass
+		for (int step = 0; step < CHUNK_SIZE_Z; step++)
+		{
+			int z = (pass & 1) ? step : CHUNK_MAX_Z - step;
+			bool isNeighbourhoodActive = isLayerActive[z] || (z > 0 && (isLayerActive[z - 1] || hasLayerChanged[z - 1])) || (z < CHUNK_MAX_Z && (isLayerActive[z + 1] || hasLayerChanged[z + 1]));
+			if (!isNeighbourhoodActive)
+				continue;
+
+			hasLayerChanged[z] = SpreadLightInLayer(z, outdoorLight.data(), indoorLight.data(), isTransparent.data(), hasNeighbourMasks.data());
+			anyLayerChanged |= hasLayerChanged[z];
+		}
+
+		for (int z = 0; z < CHUNK_SIZE_Z; z++)
+		{
+			isLayerActive[z] = hasLayerChanged[z];
+		}
+	}
+
+	for (int blockIndex = 0; blockIndex < CHUNK_TOTAL_BLOCKS; blockIndex++)
+	{
+		blocks[blockIndex].m_lightInfluence = uint8_t((outdoorLight[LIGHT_PLANE_PADDING + blockIndex] << 4) | indoorLight[LIGHT_PLANE_PADDING + blockIndex]);
+	}
+}
+
+uint64_t ChunkLighting::ComputeLightInputHash(const ChunkBlockData& blockData)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+	for (int typeIndex = 0; typeIndex < (int)BlockDefintion::s_definitions.size(); typeIndex++)
+	{
+		hash = (hash ^ uint8_t(BlockDefintion::IsBlockTypeOpaque(typeIndex) ? 1 : 0)) * FNV_PRIME;
+		hash = (hash ^ BlockDefintion::s_definitions[typeIndex].m_indoorLightInfluence) * FNV_PRIME;
+	}
+
+	for (int blockIndex = 0; blockIndex < CHUNK_TOTAL_BLOCKS; blockIndex++)
+	{
+		hash = (hash ^ blockData.m_blocks[blockIndex].m_typeIndex) * FNV_PRIME;
+	}
+	return hash;
+}
+
+bool ChunkLighting::DoesLightSpread(const Block& from, const Block& to)
+{
+	if (BlockDefintion::IsBlockTypeOpaque(to.m_typeIndex))
+		return false;
+
+	return from.GetOutdoorLightInfluence() > to.GetOutdoorLightInfluence() + 1 || from.GetIndoorLightInfluence() > to.GetIndoorLightInfluence() + 1;
+}
+
+bool ChunkLighting::SpreadLightInLayer(int z, uint8_t* outdoorLight, uint8_t* indoorLight, const uint8_t* isTransparent, const uint8_t* hasNeighbourMasks)
+{
+	//raises every non opaque block of the layer to one less than its brightest neighbour, over and over until the layer stops changing
+	const __m128i one = _mm_set1_epi8(1);
+	int layerStart = LIGHT_PLANE_PADDING + (z << (CHUNK_BITS_X + CHUNK_BITS_Y));
+	uint8_t* planes[NUM_LIGHT_CHANNELS] = { outdoorLight, indoorLight };
+	bool hasChanged = false;
+	bool isSpreading = true;
+	while (isSpreading)
+	{
+		isSpreading = false;
+		for (int channel = 0; channel < NUM_LIGHT_CHANNELS; channel++)
+		{
+			uint8_t* light = planes[channel];
+			for (int columnIndex = 0; columnIndex < CHUNK_BLOCKS_PER_LAYER; columnIndex += 16)
+			{
+				int planeIndex = layerStart + columnIndex;
+				__m128i west = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&light[planeIndex - CHUNK_STEP_X])),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(&hasNeighbourMasks[LAYER_EDGE_WEST * CHUNK_BLOCKS_PER_LAYER + columnIndex])));
+				__m128i east = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&light[planeIndex + CHUNK_STEP_X])),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(&hasNeighbourMasks[LAYER_EDGE_EAST * CHUNK_BLOCKS_PER_LAYER + columnIndex])));
+				__m128i south = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&light[planeIndex - CHUNK_STEP_Y])),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(&hasNeighbourMasks[LAYER_EDGE_SOUTH * CHUNK_BLOCKS_PER_LAYER + columnIndex])));
+				__m128i north = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&light[planeIndex + CHUNK_STEP_Y])),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(&hasNeighbourMasks[LAYER_EDGE_NORTH * CHUNK_BLOCKS_PER_LAYER + columnIndex])));
+				__m128i below = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&light[planeIndex - CHUNK_STEP_Z]));
+				__m128i above = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&light[planeIndex + CHUNK_STEP_Z]));
+				__m128i brightest = _mm_max_epu8(_mm_max_epu8(_mm_max_epu8(west, east), _mm_max_epu8(south, north)), _mm_max_epu8(below, above));
+
+				//opaque blocks keep what they give off themselves, they only pass light on
+				__m128i spread = _mm_and_si128(_mm_subs_epu8(brightest, one), _mm_loadu_si128(reinterpret_cast<const __m128i*>(&isTransparent[planeIndex])));
+				__m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&light[planeIndex]));
+				__m128i raised = _mm_max_epu8(current, spread);
+				if (_mm_movemask_epi8(_mm_cmpeq_epi8(raised, current)) != 0xFFFF)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(&light[planeIndex]), raised);
+					isSpreading = true;
+					hasChanged = true;
+				}
+			}
+		}
+	}
+	return hasChanged;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "Game/Chunk.hpp"
+
+//light propagation that stays inside one chunk, run by the chunk's generation job on blocks no other thread can see yet
+//light crossing into the neighbouring chunks is left to the world, which only reconciles the sides a chunk shares with its active neighbours
+class ChunkLighting
+{
+public:
+	//sets both light channels of every block from the chunk's own sky columns and light emitting blocks
+	//works a whole layer at a time with simd, edits and light crossing chunk borders go through the world's light queues instead
+	static void ComputeLocalLighting(ChunkBlockData& blockData);
+	//hash of everything the chunk's own light is worked out from, its block types and how opaque and bright each type is
+	static uint64_t ComputeLightInputHash(const ChunkBlockData& blockData);
+	//whether light in either channel of from is bright enough to raise that of its neighbour to
+	static bool DoesLightSpread(const Block& from, const Block& to);
+
+private:
+	//one light byte per block and channel, padded by a layer above and below, returns whether any block in the layer got brighter
+	static bool SpreadLightInLayer(int z, uint8_t* outdoorLight, uint8_t* indoorLight, const uint8_t* isTransparent, const uint8_t* hasNeighbourMasks);
+};
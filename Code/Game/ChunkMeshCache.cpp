@@ -0,0 +1,165 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include "Engine/Core/FileUtils.hpp"
+#include "Engine/Core/StringUtils.hpp"
+#include "Engine/Math/IntVec3.hpp"
+#include "Game/ChunkMeshCache.hpp"
+#include "Game/PaddedChunkView.hpp"
+
+//bump whenever the mesher changes what it builds from the same blocks, so old cache files are rebuilt instead of used
+constexpr uint8_t MESH_CACHE_VERSION = 1;
+constexpr int MESH_CACHE_HEADER_SIZE = 8;
+constexpr int MESH_CACHE_SLICE_HEADER_SIZE = 16;
+
+ChunkMeshCache::ChunkMeshCache(const std::string& filePath)
+	:m_filePath(filePath)
+{
+}
+
+bool ChunkMeshCache::LoadFromFile()
+{
+	if (!DoesFileExist(m_filePath))
+		return false;
+
+	std::vector<uint8_t> buffer;
+	FileReadToBuffer(buffer, m_filePath);
+	if (buffer.size() < MESH_CACHE_HEADER_SIZE || buffer[0] != 'G' || buffer[1] != 'M' || buffer[2] != 'S' || buffer[3] != 'H' ||
+		buffer[4] != MESH_CACHE_VERSION || buffer[5] != CHUNK_BITS_X || buffer[6] != CHUNK_BITS_Y || buffer[7] != CHUNK_BITS_Z)
+	{
+		return false;
+	}
+
+	//a file cut short (e.g. by a crash while it was written) is ignored as a whole
+	size_t readOffset = MESH_CACHE_HEADER_SIZE;
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
+	{
+		if (readOffset + MESH_CACHE_SLICE_HEADER_SIZE > buffer.size())
+			return false;
+
+		uint64_t sliceKey = 0;
+		uint32_t numOpaqueVertices = 0;
+		uint32_t numTranslucentVertices = 0;
+		memcpy(&sliceKey, &buffer[readOffset], sizeof(sliceKey));
+		memcpy(&numOpaqueVertices, &buffer[readOffset + 8], sizeof(numOpaqueVertices));
+		memcpy(&numTranslucentVertices, &buffer[readOffset + 12], sizeof(numTranslucentVertices));
+		readOffset += MESH_CACHE_SLICE_HEADER_SIZE;
+
+		size_t numVertexBytes = (size_t(numOpaqueVertices) + size_t(numTranslucentVertices)) * sizeof(ChunkVertex);
+		if (readOffset + numVertexBytes > buffer.size())
+			return false;
+
+		m_sliceKeys[slice] = sliceKey;
+		m_opaqueVertices[slice].resize(numOpaqueVertices);
+		m_translucentVertices[slice].resize(numTranslucentVertices);
+		if (numOpaqueVertices > 0)
+			memcpy(m_opaqueVertices[slice].data(), &buffer[readOffset], numOpaqueVertices * sizeof(ChunkVertex));
+		readOffset += numOpaqueVertices * sizeof(ChunkVertex);
+		if (numTranslucentVertices > 0)
+			memcpy(m_translucentVertices[slice].data(), &buffer[readOffset], numTranslucentVertices * sizeof(ChunkVertex));
+		readOffset += numTranslucentVertices * sizeof(ChunkVertex);
+	}
+
+	return true;
+}
+
+void ChunkMeshCache::SaveToFile() const
+{
+	size_t bufferSize = MESH_CACHE_HEADER_SIZE;
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
+	{
+		bufferSize += MESH_CACHE_SLICE_HEADER_SIZE + (m_opaqueVertices[slice].size() + m_translucentVertices[slice].size()) * sizeof(ChunkVertex);
+	}
+
+	std::vector<uint8_t> buffer(bufferSize);
+	buffer[0] = 'G';
+	buffer[1] = 'M';
+	buffer[2] = 'S';
+	buffer[3] = 'H';
+	buffer[4] = MESH_CACHE_VERSION;
+	buffer[5] = CHUNK_BITS_X;
+	buffer[6] = CHUNK_BITS_Y;
+	buffer[7] = CHUNK_BITS_Z;
+
+	size_t writeOffset = MESH_CACHE_HEADER_SIZE;
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
+	{
+		uint32_t numOpaqueVertices = (uint32_t)m_opaqueVertices[slice].size();
+		uint32_t numTranslucentVertices = (uint32_t)m_translucentVertices[slice].size();
+		memcpy(&buffer[writeOffset], &m_sliceKeys[slice], sizeof(uint64_t));
+		memcpy(&buffer[writeOffset + 8], &numOpaqueVertices, sizeof(numOpaqueVertices));
+		memcpy(&buffer[writeOffset + 12], &numTranslucentVertices, sizeof(numTranslucentVertices));
+		writeOffset += MESH_CACHE_SLICE_HEADER_SIZE;
+
+		if (numOpaqueVertices > 0)
+			memcpy(&buffer[writeOffset], m_opaqueVertices[slice].data(), numOpaqueVertices * sizeof(ChunkVertex));
+		writeOffset += numOpaqueVertices * sizeof(ChunkVertex);
+		if (numTranslucentVertices > 0)
+			memcpy(&buffer[writeOffset], m_translucentVertices[slice].data(), numTranslucentVertices * sizeof(ChunkVertex));
+		writeOffset += numTranslucentVertices * sizeof(ChunkVertex);
+	}
+
+	//written next to the old file and moved over it, so a crash mid write never leaves a cut short cache where the chunk looks for it
+	//save jobs of the same chunk can run at the same time, each writes its own temporary file and the last one moved over the file is kept
+	static std::atomic<uint32_t> s_nextTempFileNumber(0);
+	std::string tempFilePath = Stringf("%s.%u.tmp", m_filePath.c_str(), s_nextTempFileNumber++);
+	BufferWriteToFile(buffer, tempFilePath);
+	std::remove(m_filePath.c_str());
+	if (std::rename(tempFilePath.c_str(), m_filePath.c_str()) != 0)
+	{
+		std::remove(tempFilePath.c_str());
+	}
+}
+
+bool ChunkMeshCache::TryGetSlice(int slice, uint64_t sliceKey, ChunkMeshData& out_meshData) const
+{
+	if (m_sliceKeys[slice] != sliceKey)
+		return false;
+
+	out_meshData = ChunkMeshData();
+	out_meshData.m_opaquePackedVertices = m_opaqueVertices[slice];
+	out_meshData.m_translucentPackedVertices = m_translucentVertices[slice];
+	return true;
+}
+
+void ChunkMeshCache::TakeSlice(int slice, uint64_t sliceKey, ChunkMeshData& meshData)
+{
+	m_sliceKeys[slice] = sliceKey;
+	std::swap(m_opaqueVertices[slice], meshData.m_opaquePackedVertices);
+	std::swap(m_translucentVertices[slice], meshData.m_translucentPackedVertices);
+}
+
+size_t ChunkMeshCache::GetMemoryBytes() const
+{
+	size_t memoryBytes = 0;
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
+	{
+		memoryBytes += sizeof(ChunkVertex) * (m_opaqueVertices[slice].capacity() + m_translucentVertices[slice].capacity());
+	}
+
+	return memoryBytes;
+}
+
+uint64_t ChunkMeshCache::ComputeSliceKey(const PaddedChunkView& paddedView, const ChunkMeshInput& input, int slice)
+{
+	//fnv-1a over the mesher settings and the type and light of every block the slice's faces are built from, which is its layers plus one all around
+	uint64_t hash = FNV_OFFSET_BASIS;
+	const uint8_t settings[3] = { uint8_t(slice), uint8_t(input.m_mesherType), uint8_t(BlockDefintion::s_definitions.size()) };
+	for (int i = 0; i < 3; i++)
+	{
+		hash = (hash ^ settings[i]) * FNV_PRIME;
+	}
+
+	int minZ = slice * CHUNK_MESH_SLICE_HEIGHT;
+	int firstPaddedIndex = PaddedChunkView::GetPaddedIndexFromLocalCoords(IntVec3(-1, -1, minZ - 1));
+	int numPaddedBlocks = (CHUNK_MESH_SLICE_HEIGHT + 2) * PADDED_BLOCKS_PER_LAYER;
+	for (int i = firstPaddedIndex; i < firstPaddedIndex + numPaddedBlocks; i++)
+	{
+		const Block& block = paddedView.GetBlock(i);
+		hash = (hash ^ block.m_typeIndex) * FNV_PRIME;
+		hash = (hash ^ block.m_lightInfluence) * FNV_PRIME;
+	}
+
+	//0 marks an empty cache entry
+	return hash != 0 ? hash : 1;
+}
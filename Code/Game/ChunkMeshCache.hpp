@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Game/ChunkMesher.hpp"
+
+class PaddedChunkView;
+
+//mesh of every slice of a chunk as it was last built, kept in a file next to the chunk's save file
+//each slice is keyed by a hash of everything its mesh is built from (the blocks and light of its layers and the borders from the neighbours, plus the mesher settings),
+//so a chunk that comes back unchanged loads its slices instead of meshing them again
+//only the packed vertices are kept, pcu meshes are decoded from them after loading like after building
+//the first mesh job after a chunk is loaded reads the file, the chunk keeps what it read for its later jobs until one has all four neighbours
+//the chunk itself only keeps the key of each slice next to its cpu mesh, when that mesh is released or the chunk is deactivated a save job writes them out
+class ChunkMeshCache
+{
+public:
+	ChunkMeshCache(const std::string& filePath);
+	bool LoadFromFile();
+	void SaveToFile() const;
+	bool TryGetSlice(int slice, uint64_t sliceKey, ChunkMeshData& out_meshData) const;
+	//moves the packed vertices out of meshData, for meshes that are dropped right after
+	void TakeSlice(int slice, uint64_t sliceKey, ChunkMeshData& meshData);
+	size_t GetMemoryBytes() const;
+
+	static uint64_t ComputeSliceKey(const PaddedChunkView& paddedView, const ChunkMeshInput& input, int slice);
+
+private:
+	std::string m_filePath;
+	uint64_t m_sliceKeys[CHUNK_NUM_MESH_SLICES] = {};		//0 for slices that have nothing cached
+	std::vector<ChunkVertex> m_opaqueVertices[CHUNK_NUM_MESH_SLICES];
+	std::vector<ChunkVertex> m_translucentVertices[CHUNK_NUM_MESH_SLICES];
+};
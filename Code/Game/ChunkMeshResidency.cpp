@@ -0,0 +1,143 @@
+#include <algorithm>
+#include "Engine/Math/MathUtils.hpp"
+#include "Engine/Core/DevConsole.hpp"
+#include "Engine/Core/StringUtils.hpp"
+#include "Game/ChunkMeshResidency.hpp"
+#include "Game/Chunk.hpp"
+#include "Game/World.hpp"
+
+extern DevConsole* g_theConsole;
+
+ChunkMeshResidency::ChunkMeshResidency(size_t memoryBudgetBytes, float keepCpuMeshRange)
+	:m_memoryBudgetBytes(memoryBudgetBytes), m_keepCpuMeshRange(keepCpuMeshRange)
+{
+}
+
+void ChunkMeshResidency::Update(const std::map<IntVec2, Chunk*>& activeChunks, const Vec2& cameraXY)
+{
+	m_cameraXY = cameraXY;
+
+	m_memoryInUseBytes = m_meshCacheBytesPendingSave;
+	for (auto iter = activeChunks.begin(); iter != activeChunks.end(); ++iter)
+	{
+		Chunk* chunk = iter->second;
+		if (IsInKeepRange(*chunk))
+		{
+			//never leave a hole in the world close to the camera, whatever the budget says
+			if (chunk->IsMeshEvicted())
+				chunk->RestoreMesh();
+		}
+		m_memoryInUseBytes += chunk->GetCpuMeshBytes() + chunk->GetGpuMeshBytes();
+	}
+
+	if (m_memoryInUseBytes > m_memoryBudgetBytes)
+	{
+		EvictUntilWithinBudget(activeChunks);
+	}
+	else
+	{
+		RestoreEvictedMeshes(activeChunks);
+	}
+}
+
+bool ChunkMeshResidency::ShouldKeepCpuMesh(const Chunk& chunk) const
+{
+	return IsInKeepRange(chunk);
+}
+
+void ChunkMeshResidency::AddMeshCacheBytesPendingSave(size_t bytes)
+{
+	m_meshCacheBytesPendingSave += bytes;
+	m_memoryInUseBytes += bytes;
+}
+
+void ChunkMeshResidency::RemoveMeshCacheBytesPendingSave(size_t bytes)
+{
+	m_meshCacheBytesPendingSave -= bytes;
+	m_memoryInUseBytes -= std::min(bytes, m_memoryInUseBytes);
+}
+
+bool ChunkMeshResidency::IsInKeepRange(const Chunk& chunk) const
+{
+	Vec2 chunkCenter = Chunk::GetChunkCenterXYForGlobalChunkCoords(chunk.GetChunkCoordinates());
+	return GetDistanceSquared2D(m_cameraXY, chunkCenter) < m_keepCpuMeshRange * m_keepCpuMeshRange;
+}
+
+void ChunkMeshResidency::EvictUntilWithinBudget(const std::map<IntVec2, Chunk*>& activeChunks)
+{
+	std::vector<Chunk*> candidates;
+	for (auto iter = activeChunks.begin(); iter != activeChunks.end(); ++iter)
+	{
+		Chunk* chunk = iter->second;
+		if (!IsInKeepRange(*chunk) && !chunk->IsMeshJobPending() && (chunk->GetCpuMeshBytes() > 0 || chunk->GetGpuMeshBytes() > 0))
+			candidates.push_back(chunk);
+	}
+
+	//farthest first, those are the chunks least likely to be looked at or walked back to
+	Vec2 cameraXY = m_cameraXY;
+	std::sort(candidates.begin(), candidates.end(), [cameraXY](Chunk* a, Chunk* b)
+		{
+			float aDistSquared = GetDistanceSquared2D(cameraXY, Chunk::GetChunkCenterXYForGlobalChunkCoords(a->GetChunkCoordinates()));
+			float bDistSquared = GetDistanceSquared2D(cameraXY, Chunk::GetChunkCenterXYForGlobalChunkCoords(b->GetChunkCoordinates()));
+			return aDistSquared > bDistSquared;
+		});
+
+	//cpu meshes go first, dropping them does not take anything off the screen
+	int numCpuMeshesReleased = 0;
+	for (int i = 0; i < (int)candidates.size() && m_memoryInUseBytes > m_memoryBudgetBytes; i++)
+	{
+		size_t cpuMeshBytes = candidates[i]->GetCpuMeshBytes();
+		if (cpuMeshBytes == 0)
+			continue;
+
+		//the loaded mesh cache outlives the released mesh, so only what was actually freed is taken off, slices handed to a save job are added back when it is queued
+		candidates[i]->ReleaseCpuMesh();
+		m_memoryInUseBytes -= cpuMeshBytes - candidates[i]->GetCpuMeshBytes();
+		numCpuMeshesReleased++;
+	}
+
+	int numMeshesEvicted = 0;
+	for (int i = 0; i < (int)candidates.size() && m_memoryInUseBytes > m_memoryBudgetBytes; i++)
+	{
+		size_t gpuMeshBytes = candidates[i]->GetGpuMeshBytes();
+		if (gpuMeshBytes == 0)
+			continue;
+
+		size_t cpuMeshBytes = candidates[i]->GetCpuMeshBytes();
+		candidates[i]->EvictMesh();
+		m_memoryInUseBytes -= gpuMeshBytes + cpuMeshBytes;
+		numMeshesEvicted++;
+	}
+
+	if (numCpuMeshesReleased == 0 && numMeshesEvicted == 0)
+		return;
+
+	g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("Chunk meshes over budget, released %d cpu meshes and evicted %d meshes, %.1f of %.1f MB in use",
+		numCpuMeshesReleased, numMeshesEvicted, float(m_memoryInUseBytes) / (1024.f * 1024.f), float(m_memoryBudgetBytes) / (1024.f * 1024.f)));
+}
+
+void ChunkMeshResidency::RestoreEvictedMeshes(const std::map<IntVec2, Chunk*>& activeChunks)
+{
+	std::vector<Chunk*> evictedChunks;
+	for (auto iter = activeChunks.begin(); iter != activeChunks.end(); ++iter)
+	{
+		if (iter->second->IsMeshEvicted())
+			evictedChunks.push_back(iter->second);
+	}
+	if (evictedChunks.empty())
+		return;
+
+	std::sort(evictedChunks.begin(), evictedChunks.end(), ChunkSort(m_cameraXY));
+
+	//leave some headroom so a restored mesh does not push the world straight back over budget
+	size_t restoreLimitBytes = (m_memoryBudgetBytes / 10) * 9;
+	for (int i = 0; i < (int)evictedChunks.size(); i++)
+	{
+		size_t expectedBytes = evictedChunks[i]->GetEvictedMeshBytes();
+		if (m_memoryInUseBytes + expectedBytes > restoreLimitBytes)
+			break;
+
+		evictedChunks[i]->RestoreMesh();
+		m_memoryInUseBytes += expectedBytes;
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <map>
+#include "Engine/Math/IntVec2.hpp"
+#include "Engine/Math/Vec2.hpp"
+
+class Chunk;
+
+//decides which chunk meshes stay in memory
+//chunks outside m_keepCpuMeshRange drop their cpu mesh as soon as it is uploaded, closer chunks keep it so an edit only has to rebuild the slices it touches
+//the budget covers the cpu and gpu meshes of all chunks, their loaded mesh caches and the mesh caches still waiting in save jobs
+//when it is exceeded, cpu meshes and then gpu meshes are evicted farthest from the camera first, evicted gpu meshes are rebuilt closest first once there is room again
+class ChunkMeshResidency
+{
+public:
+	ChunkMeshResidency(size_t memoryBudgetBytes, float keepCpuMeshRange);
+	void Update(const std::map<IntVec2, Chunk*>& activeChunks, const Vec2& cameraXY);
+	bool ShouldKeepCpuMesh(const Chunk& chunk) const;
+	void AddMeshCacheBytesPendingSave(size_t bytes);
+	void RemoveMeshCacheBytesPendingSave(size_t bytes);
+	size_t GetMemoryInUse() const { return m_memoryInUseBytes; }
+	size_t GetMemoryBudget() const { return m_memoryBudgetBytes; }
+
+private:
+	size_t m_memoryBudgetBytes = 0;
+	size_t m_memoryInUseBytes = 0;
+	size_t m_meshCacheBytesPendingSave = 0;		//handed from chunks to save jobs that have not finished yet
+	float m_keepCpuMeshRange = 0.f;
+	Vec2 m_cameraXY = Vec2::ZERO;
+
+private:
+	bool IsInKeepRange(const Chunk& chunk) const;
+	void EvictUntilWithinBudget(const std::map<IntVec2, Chunk*>& activeChunks);
+	void RestoreEvictedMeshes(const std::map<IntVec2, Chunk*>& activeChunks);
+};
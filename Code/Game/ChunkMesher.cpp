@@ -0,0 +1,625 @@
+#include <emmintrin.h>
+#include "Engine/Math/IntVec3.hpp"
+#include "Engine/Math/MathUtils.hpp"
+#include "Engine/Core/Time.hpp"
+#include "Game/ChunkMesher.hpp"
+#include "Game/ChunkMeshCache.hpp"
+#include "Game/PaddedChunkView.hpp"
+
+//padded index step to the block in front of each face, in BlockFace order
+constexpr int FACE_NEIGHBOUR_STEPS[NUM_BLOCK_FACES] = { -PADDED_STEP_Z, PADDED_STEP_Z, -PADDED_STEP_X, -PADDED_STEP_Y, PADDED_STEP_X, PADDED_STEP_Y };
+
+template <>
+void BlockShapeKernel<BLOCK_SHAPE_CUBE>::AddVerts(ChunkMeshData& meshData, const BlockShapeContext& context, const BlockDefintion& blockDef, const IntVec3& localCoords, int paddedIndex, uint8_t faceMask)
+{
+	IntVec3 localMaxs(localCoords.x + 1, localCoords.y + 1, localCoords.z + 1);
+	for (int face = 0; face < NUM_BLOCK_FACES; face++)
+	{
+		if ((faceMask & (1 << face)) == 0)
+			continue;
+
+		const Block& frontBlock = context.m_paddedView->GetBlock(paddedIndex + FACE_NEIGHBOUR_STEPS[face]);
+		ChunkMesher::AddVertsForFace(meshData.m_opaquePackedVertices, localCoords, localMaxs, BlockFace(face), frontBlock, ChunkMesher::GetFaceSpriteIndex(blockDef, BlockFace(face)), 0);
+	}
+}
+
+template <>
+void BlockShapeKernel<BLOCK_SHAPE_FLUID>::AddVerts(ChunkMeshData& meshData, const BlockShapeContext& context, const BlockDefintion& blockDef, const IntVec3& localCoords, int paddedIndex, uint8_t faceMask)
+{
+	//water is drawn at half alpha, only the faces that look out into air or other non opaque blocks
+	uint8_t flags = CHUNK_VERTEX_FLAG_TRANSLUCENT;
+
+	IntVec3 localMaxs(localCoords.x + 1, localCoords.y + 1, localCoords.z + 1);
+	for (int face = 0; face < NUM_BLOCK_FACES; face++)
+	{
+		if ((faceMask & (1 << face)) == 0 || (context.m_mergeWaterSurface && face == BLOCK_FACE_TOP))
+			continue;
+
+		uint8_t faceFlags = flags;
+		//if this is the top most water block, flag its surface for vertex animations
+		if (face == BLOCK_FACE_TOP && localCoords.z == SEA_LEVEL)
+			faceFlags |= CHUNK_VERTEX_FLAG_WAVE;
+		ChunkMesher::AddVertsForFace(meshData.m_translucentPackedVertices, localCoords, localMaxs, BlockFace(face), context.m_paddedView->GetBlock(paddedIndex + FACE_NEIGHBOUR_STEPS[face]),
+			ChunkMesher::GetFaceSpriteIndex(blockDef, BlockFace(face)), faceFlags);
+	}
+}
+
+template <>
+void BlockShapeKernel<BLOCK_SHAPE_CROSS>::AddVerts(ChunkMeshData& meshData, const BlockShapeContext& context, const BlockDefintion& blockDef, const IntVec3& localCoords, int paddedIndex, uint8_t faceMask)
+{
+	UNUSED(faceMask);
+
+	//the quads run through the inside of the block, so the block's own light is used and every quad is added with both windings
+	//their face is only there to fill the vertex, nothing offsets plant quads along it
+	const Block& block = context.m_paddedView->GetBlock(paddedIndex);
+	//the diagonal quads are a whole block wide and tall, so they take the sprite's corners instead of being tiled
+	uint16_t spriteIndex = blockDef.m_sideSpriteIndex;
+	uint8_t flags = 0;
+	int minX = localCoords.x * BLOCK_MODEL_UNITS;
+	int minY = localCoords.y * BLOCK_MODEL_UNITS;
+	int minZ = localCoords.z * BLOCK_MODEL_UNITS;
+	int maxZ = minZ + BLOCK_MODEL_UNITS;
+
+	//the ends of the two diagonals of the block's footprint
+	const int diagonals[2][2][2] =
+	{
+		{ { 0, 0 }, { BLOCK_MODEL_UNITS, BLOCK_MODEL_UNITS } },
+		{ { BLOCK_MODEL_UNITS, 0 }, { 0, BLOCK_MODEL_UNITS } },
+	};
+	const BlockFace faces[2][2] = { { BLOCK_FACE_SOUTH, BLOCK_FACE_NORTH }, { BLOCK_FACE_EAST, BLOCK_FACE_WEST } };
+	for (int diagonal = 0; diagonal < 2; diagonal++)
+	{
+		IntVec3 startBottom(minX + diagonals[diagonal][0][0], minY + diagonals[diagonal][0][1], minZ);
+		IntVec3 startTop(startBottom.x, startBottom.y, maxZ);
+		IntVec3 endBottom(minX + diagonals[diagonal][1][0], minY + diagonals[diagonal][1][1], minZ);
+		IntVec3 endTop(endBottom.x, endBottom.y, maxZ);
+
+		const IntVec3 frontCorners[NUM_FACE_CORNERS] = { startTop, startBottom, endBottom, endTop };
+		const IntVec3 backCorners[NUM_FACE_CORNERS] = { endTop, endBottom, startBottom, startTop };
+		ChunkMesher::AddVertsForQuad(meshData.m_opaquePackedVertices, frontCorners, faces[diagonal][0], block, spriteIndex, flags);
+		ChunkMesher::AddVertsForQuad(meshData.m_opaquePackedVertices, backCorners, faces[diagonal][1], block, spriteIndex, flags);
+	}
+}
+
+template <>
+void BlockShapeKernel<BLOCK_SHAPE_SLAB>::AddVerts(ChunkMeshData& meshData, const BlockShapeContext& context, const BlockDefintion& blockDef, const IntVec3& localCoords, int paddedIndex, uint8_t faceMask)
+{
+	//the sides and bottom are hidden and lit like a cube's, the top face is halfway up the block's own space so it is always drawn and lit by the slab itself
+	const IntVec3 boxMins(0, 0, 0);
+	const IntVec3 boxMaxs(BLOCK_MODEL_UNITS, BLOCK_MODEL_UNITS, BLOCK_MODEL_UNITS / 2);
+	//tiled so the half height sides show half the sprite instead of all of it squashed
+	uint8_t flags = CHUNK_VERTEX_FLAG_TILED_UVS;
+	for (int face = 0; face < NUM_BLOCK_FACES; face++)
+	{
+		bool isInside = face == BLOCK_FACE_TOP;
+		if (!isInside && (faceMask & (1 << face)) == 0)
+			continue;
+
+		const Block& lightBlock = context.m_paddedView->GetBlock(isInside ? paddedIndex : paddedIndex + FACE_NEIGHBOUR_STEPS[face]);
+		ChunkMesher::AddVertsForSubBlockFace(meshData.m_opaquePackedVertices, localCoords, boxMins, boxMaxs, BlockFace(face), lightBlock,
+			ChunkMesher::GetFaceSpriteIndex(blockDef, BlockFace(face)), flags);
+	}
+}
+
+template <>
+void BlockShapeKernel<BLOCK_SHAPE_MODEL>::AddVerts(ChunkMeshData& meshData, const BlockShapeContext& context, const BlockDefintion& blockDef, const IntVec3& localCoords, int paddedIndex, uint8_t faceMask)
+{
+	const BlockModel& model = BlockModel::s_models[blockDef.m_modelIndex];
+	//tiled so each box face shows the part of the sprite it covers
+	uint8_t flags = CHUNK_VERTEX_FLAG_TILED_UVS;
+	for (int boxIndex = 0; boxIndex < (int)model.m_boxes.size(); boxIndex++)
+	{
+		const BlockModelBox& box = model.m_boxes[boxIndex];
+		//faces on the block's boundary are hidden and lit like a cube's, faces inside the block are always drawn and lit by the block itself
+		const bool isOnBoundary[NUM_BLOCK_FACES] = { box.m_mins.z == 0, box.m_maxs.z == BLOCK_MODEL_UNITS, box.m_mins.x == 0, box.m_mins.y == 0,
+			box.m_maxs.x == BLOCK_MODEL_UNITS, box.m_maxs.y == BLOCK_MODEL_UNITS };
+		for (int face = 0; face < NUM_BLOCK_FACES; face++)
+		{
+			if (isOnBoundary[face] && (faceMask & (1 << face)) == 0)
+				continue;
+
+			const Block& lightBlock = context.m_paddedView->GetBlock(isOnBoundary[face] ? paddedIndex + FACE_NEIGHBOUR_STEPS[face] : paddedIndex);
+			ChunkMesher::AddVertsForSubBlockFace(meshData.m_opaquePackedVertices, localCoords, box.m_mins, box.m_maxs, BlockFace(face), lightBlock,
+				ChunkMesher::GetFaceSpriteIndex(blockDef, BlockFace(face)), flags);
+		}
+	}
+}
+
+int ChunkMesher::BuildMesh(const ChunkMeshInput& input, const ChunkMeshCache* loadedMeshCache, uint64_t* out_sliceKeys, ChunkMeshData* out_meshSlices)
+{
+	//the padded view is too big for a worker thread's stack
+	PaddedChunkView* paddedView = new PaddedChunkView();
+	//a missing neighbour hides the faces on its side, the chunk rebuilds them once the neighbour is there
+	paddedView->m_missingNeighbourBlock.m_typeIndex = BlockDefintion::GetDefinitionIndexByName("stone");
+	paddedView->Populate(*input.m_chunk, input.m_eastNeighbour.get(), input.m_westNeighbour.get(), input.m_northNeighbour.get(), input.m_southNeighbour.get());
+
+	BlockShapeContext context;
+	context.m_paddedView = paddedView;
+	context.m_mergeWaterSurface = input.m_mesherType == CHUNK_MESHER_GREEDY;
+
+	int numCachedSlices = 0;
+	std::vector<uint8_t> faceMasks(CHUNK_TOTAL_BLOCKS);
+	const __m128i zero = _mm_setzero_si128();
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES; slice++)
+	{
+		if ((input.m_meshSlices & (1u << slice)) == 0)
+			continue;
+
+		ChunkMeshData& meshData = out_meshSlices[slice];
+		if (input.m_useMeshCache)
+		{
+			out_sliceKeys[slice] = ChunkMeshCache::ComputeSliceKey(*paddedView, input, slice);
+			if (loadedMeshCache && loadedMeshCache->TryGetSlice(slice, out_sliceKeys[slice], meshData))
+			{
+				numCachedSlices++;
+				continue;
+			}
+		}
+
+		meshData = ChunkMeshData();
+		int minZ = slice * CHUNK_MESH_SLICE_HEIGHT;
+		int maxZ = minZ + CHUNK_MESH_SLICE_HEIGHT;
+
+		//first work out which faces of which blocks are exposed, so emission only visits blocks that produce geometry
+		ComputeFaceMasks(*paddedView, minZ, maxZ, faceMasks.data());
+
+		if (input.m_mesherType == CHUNK_MESHER_GREEDY)
+		{
+			AddVertsForOpaqueFacesGreedy(meshData, *paddedView, faceMasks.data(), minZ, maxZ);
+		}
+		if (context.m_mergeWaterSurface)
+		{
+			AddVertsForWaterSurfaceGreedy(meshData, *paddedView, faceMasks.data(), minZ, maxZ);
+		}
+
+		for (int groupStart = minZ * CHUNK_BLOCKS_PER_LAYER; groupStart < maxZ * CHUNK_BLOCKS_PER_LAYER; groupStart += 16)
+		{
+			//skip 16 blocks at a time when none of them has anything to draw, which is most of the air and buried stone
+			__m128i groupMasks = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&faceMasks[groupStart]));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(groupMasks, zero)) == 0xFFFF)
+				continue;
+
+			for (int blockIndex = groupStart; blockIndex < groupStart + 16; blockIndex++)
+			{
+				uint8_t faceMask = faceMasks[blockIndex];
+				if (faceMask == 0)
+					continue;
+
+				IntVec3 localCoords(blockIndex & CHUNK_MASK_X, (blockIndex >> CHUNK_BITS_X) & CHUNK_MAX_Y, blockIndex >> (CHUNK_BITS_X + CHUNK_BITS_Y));
+				int paddedIndex = PaddedChunkView::GetPaddedIndexFromLocalCoords(localCoords);
+				const BlockDefintion& blockDef = BlockDefintion::s_definitions[paddedView->GetBlock(paddedIndex).m_typeIndex];
+				if (faceMask & (FACE_MASK_WATER | FACE_MASK_SHAPED))
+					AddVertsForShapedBlock(meshData, context, blockDef, localCoords, paddedIndex, faceMask);
+				else if (input.m_mesherType != CHUNK_MESHER_GREEDY)
+					BlockShapeKernel<BLOCK_SHAPE_CUBE>::AddVerts(meshData, context, blockDef, localCoords, paddedIndex, faceMask);
+			}
+		}
+	}
+
+	delete paddedView;
+	return numCachedSlices;
+}
+
+void ChunkMesher::DecodeMeshToPCU(ChunkMeshData& meshData, const Vec3& chunkWorldMins)
+{
+	meshData.m_opaqueVertices.reserve(meshData.m_opaquePackedVertices.size());
+	for (int i = 0; i < (int)meshData.m_opaquePackedVertices.size(); i++)
+	{
+		meshData.m_opaqueVertices.push_back(meshData.m_opaquePackedVertices[i].DecodeToPCU(chunkWorldMins));
+	}
+	meshData.m_translucentVertices.reserve(meshData.m_translucentPackedVertices.size());
+	for (int i = 0; i < (int)meshData.m_translucentPackedVertices.size(); i++)
+	{
+		meshData.m_translucentVertices.push_back(meshData.m_translucentPackedVertices[i].DecodeToPCU(chunkWorldMins));
+	}
+
+	//nothing reads the packed vertices after this
+	std::vector<ChunkVertex>().swap(meshData.m_opaquePackedVertices);
+	std::vector<ChunkVertex>().swap(meshData.m_translucentPackedVertices);
+}
+
+void ChunkMesher::ComputeFaceMasks(const PaddedChunkView& paddedView, int minZ, int maxZ, uint8_t* out_faceMasks)
+{
+	static_assert(CHUNK_BLOCKS_PER_LAYER % 16 == 0, "Face masks are processed 16 blocks at a time");
+
+	//per type lookups, 0xFF for true so they can be used directly as simd masks
+	uint8_t isOpaqueByType[256] = {};
+	uint8_t hidesWaterByType[256] = {};
+	uint8_t hasFacesByType[256] = {};
+	uint8_t isWaterByType[256] = {};
+	uint8_t isShapedByType[256] = {};
+	for (int typeIndex = 0; typeIndex < (int)BlockDefintion::s_definitions.size(); typeIndex++)
+	{
+		const BlockDefintion& blockDef = BlockDefintion::s_definitions[typeIndex];
+		bool isWater = blockDef.m_shape == BLOCK_SHAPE_FLUID;
+		bool isShaped = blockDef.m_shape != BLOCK_SHAPE_CUBE && !isWater;
+		isOpaqueByType[typeIndex] = blockDef.m_opaque ? 0xFF : 0;
+		hidesWaterByType[typeIndex] = (blockDef.m_opaque || isWater) ? 0xFF : 0;
+		hasFacesByType[typeIndex] = (blockDef.m_visible && !isWater) ? 0xFF : 0;
+		isWaterByType[typeIndex] = (blockDef.m_visible && isWater) ? 0xFF : 0;
+		isShapedByType[typeIndex] = (blockDef.m_visible && isShaped) ? FACE_MASK_SHAPED : 0;
+	}
+
+	//the padded layers from one below to one above the range, so the border slabs from the neighbours take part in the comparisons
+	int firstPaddedIndex = PaddedChunkView::GetPaddedIndexFromLocalCoords(IntVec3(-1, -1, minZ - 1));
+	int numPaddedBlocks = (maxZ - minZ + 2) * PADDED_BLOCKS_PER_LAYER;
+	std::vector<uint8_t> isOpaque(numPaddedBlocks);
+	std::vector<uint8_t> hidesWater(numPaddedBlocks);
+	std::vector<uint8_t> hasFaces(numPaddedBlocks);
+	std::vector<uint8_t> isWater(numPaddedBlocks);
+	std::vector<uint8_t> isShaped(numPaddedBlocks);
+	for (int i = 0; i < numPaddedBlocks; i++)
+	{
+		uint8_t typeIndex = paddedView.GetBlock(firstPaddedIndex + i).m_typeIndex;
+		isOpaque[i] = isOpaqueByType[typeIndex];
+		hidesWater[i] = hidesWaterByType[typeIndex];
+		hasFaces[i] = hasFacesByType[typeIndex];
+		isWater[i] = isWaterByType[typeIndex];
+		isShaped[i] = isShapedByType[typeIndex];
+	}
+
+	//a solid block's face is exposed when the neighbour on that side is not opaque
+	//a water block's face only when the neighbour is neither opaque nor water, so submerged water has no faces at all and is skipped
+	__m128i faceBits[NUM_BLOCK_FACES];
+	for (int face = 0; face < NUM_BLOCK_FACES; face++)
+	{
+		faceBits[face] = _mm_set1_epi8(char(1 << face));
+	}
+	const __m128i waterFlag = _mm_set1_epi8(char(FACE_MASK_WATER));
+	const __m128i zero = _mm_setzero_si128();
+
+	constexpr int simdWidth = 16;
+	constexpr int simdBlocksPerRow = (CHUNK_SIZE_X / simdWidth) * simdWidth;
+	for (int z = minZ; z < maxZ; z++)
+	{
+		for (int y = 0; y < CHUNK_SIZE_Y; y++)
+		{
+			int rowPaddedIndex = PaddedChunkView::GetPaddedIndexFromLocalCoords(IntVec3(0, y, z)) - firstPaddedIndex;
+			int rowBlockIndex = Chunk::GetBlockIndexFromLocalCoords(IntVec3(0, y, z));
+			int x = 0;
+			for (; x < simdBlocksPerRow; x += simdWidth)
+			{
+				int paddedIndex = rowPaddedIndex + x;
+				__m128i solidFaces = _mm_setzero_si128();
+				__m128i waterFaces = _mm_setzero_si128();
+				for (int face = 0; face < NUM_BLOCK_FACES; face++)
+				{
+					int neighbourIndex = paddedIndex + FACE_NEIGHBOUR_STEPS[face];
+					__m128i neighbourOpaque = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&isOpaque[neighbourIndex]));
+					__m128i neighbourHidesWater = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&hidesWater[neighbourIndex]));
+					solidFaces = _mm_or_si128(solidFaces, _mm_andnot_si128(neighbourOpaque, faceBits[face]));
+					waterFaces = _mm_or_si128(waterFaces, _mm_andnot_si128(neighbourHidesWater, faceBits[face]));
+				}
+				solidFaces = _mm_and_si128(solidFaces, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&hasFaces[paddedIndex])));
+				waterFaces = _mm_and_si128(waterFaces, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&isWater[paddedIndex])));
+				__m128i waterFlags = _mm_andnot_si128(_mm_cmpeq_epi8(waterFaces, zero), waterFlag);
+				__m128i shapedFlags = _mm_andnot_si128(_mm_cmpeq_epi8(solidFaces, zero), _mm_loadu_si128(reinterpret_cast<const __m128i*>(&isShaped[paddedIndex])));
+				__m128i faceMask = _mm_or_si128(_mm_or_si128(solidFaces, shapedFlags), _mm_or_si128(waterFaces, waterFlags));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&out_faceMasks[rowBlockIndex + x]), faceMask);
+			}
+
+			//chunks narrower than 16 blocks
+			for (; x < CHUNK_SIZE_X; x++)
+			{
+				int paddedIndex = rowPaddedIndex + x;
+				uint8_t solidFaces = 0;
+				uint8_t waterFaces = 0;
+				for (int face = 0; face < NUM_BLOCK_FACES; face++)
+				{
+					int neighbourIndex = paddedIndex + FACE_NEIGHBOUR_STEPS[face];
+					if (!isOpaque[neighbourIndex])
+						solidFaces |= uint8_t(1 << face);
+					if (!hidesWater[neighbourIndex])
+						waterFaces |= uint8_t(1 << face);
+				}
+				solidFaces &= hasFaces[paddedIndex];
+				waterFaces &= isWater[paddedIndex];
+				out_faceMasks[rowBlockIndex + x] = solidFaces | (solidFaces ? isShaped[paddedIndex] : 0) | waterFaces | (waterFaces ? FACE_MASK_WATER : 0);
+			}
+		}
+	}
+}
+
+int ChunkMeshData::GetNumVertices() const
+{
+	return (int)(m_opaquePackedVertices.size() + m_translucentPackedVertices.size() + m_opaqueVertices.size() + m_translucentVertices.size());
+}
+
+size_t ChunkMeshData::GetMemoryBytes() const
+{
+	return sizeof(ChunkVertex) * (m_opaquePackedVertices.capacity() + m_translucentPackedVertices.capacity()) +
+		sizeof(Vertex_PCU) * (m_opaqueVertices.capacity() + m_translucentVertices.capacity());
+}
+
+ChunkMesherType ChunkMesher::GetMesherTypeFromName(const std::string& name)
+{
+	if (name == "greedy")
+		return CHUNK_MESHER_GREEDY;
+
+	return CHUNK_MESHER_PER_BLOCK;
+}
+
+void ChunkMesher::AddVertsForDigCrack(std::vector<ChunkVertex>& verts, const IntVec3& localCoords, const Block* const* frontBlocks, uint8_t digState)
+{
+	if (digState == 0)
+		return;
+
+	IntVec3 localMaxs(localCoords.x + 1, localCoords.y + 1, localCoords.z + 1);
+	uint16_t spriteIndex = BlockDefintion::s_digCrackSpriteIndices[digState - 1];
+	uint8_t flags = CHUNK_VERTEX_FLAG_CRACK_OVERLAY;
+	for (int face = 0; face < NUM_BLOCK_FACES; face++)
+	{
+		//faces against opaque blocks or the edge of the loaded world can not be seen
+		const Block* frontBlock = frontBlocks[face];
+		if (frontBlock == nullptr || BlockDefintion::IsBlockTypeOpaque(frontBlock->m_typeIndex))
+			continue;
+
+		AddVertsForFace(verts, localCoords, localMaxs, BlockFace(face), *frontBlock, spriteIndex, flags);
+	}
+}
+
+void ChunkMesher::AddVertsForWaterSurfaceGreedy(ChunkMeshData& meshData, const PaddedChunkView& paddedView, const uint8_t* faceMasks, int minZ, int maxZ)
+{
+	constexpr uint32_t faceKeyPresent = 1 << 24;
+	constexpr uint32_t faceKeyWave = 1 << 16;
+
+	//the surface of a sea is one flat layer of top faces, merge them like the opaque greedy mesher does, keyed on block type, light and waves
+	std::vector<uint32_t> faceKeys(CHUNK_BLOCKS_PER_LAYER);
+	std::vector<MergedFace> mergedFaces;
+	for (int z = minZ; z < maxZ; z++)
+	{
+		for (int y = 0; y < CHUNK_SIZE_Y; y++)
+		{
+			for (int x = 0; x < CHUNK_SIZE_X; x++)
+			{
+				IntVec3 localCoords(x, y, z);
+				uint8_t faceMask = faceMasks[Chunk::GetBlockIndexFromLocalCoords(localCoords)];
+				uint32_t faceKey = 0;
+				if ((faceMask & FACE_MASK_WATER) && (faceMask & (1 << BLOCK_FACE_TOP)))
+				{
+					int paddedIndex = PaddedChunkView::GetPaddedIndexFromLocalCoords(localCoords);
+					faceKey = faceKeyPresent | (z == SEA_LEVEL ? faceKeyWave : 0) | (uint32_t(paddedView.GetBlock(paddedIndex + PADDED_STEP_Z).m_lightInfluence) << 8) |
+						paddedView.GetBlock(paddedIndex).m_typeIndex;
+				}
+				faceKeys[x + (y * CHUNK_SIZE_X)] = faceKey;
+			}
+		}
+
+		MergeFaceKeys(faceKeys, CHUNK_SIZE_X, CHUNK_SIZE_Y, mergedFaces);
+		for (int i = 0; i < (int)mergedFaces.size(); i++)
+		{
+			const MergedFace& mergedFace = mergedFaces[i];
+			IntVec3 localMins(mergedFace.m_minA, mergedFace.m_minB, z);
+			IntVec3 localMaxs(mergedFace.m_minA + mergedFace.m_sizeA, mergedFace.m_minB + mergedFace.m_sizeB, z + 1);
+			const BlockDefintion& blockDef = BlockDefintion::s_definitions[mergedFace.m_faceKey & 0xFF];
+			Block frontBlock;
+			frontBlock.m_lightInfluence = uint8_t((mergedFace.m_faceKey >> 8) & 0xFF);
+			uint8_t flags = CHUNK_VERTEX_FLAG_TRANSLUCENT | CHUNK_VERTEX_FLAG_TILED_UVS;
+			if (mergedFace.m_faceKey & faceKeyWave)
+				flags |= CHUNK_VERTEX_FLAG_WAVE;
+			AddVertsForFace(meshData.m_translucentPackedVertices, localMins, localMaxs, BLOCK_FACE_TOP, frontBlock, blockDef.m_topSpriteIndex, flags);
+		}
+	}
+}
+
+void ChunkMesher::AddVertsForOpaqueFacesGreedy(ChunkMeshData& meshData, const PaddedChunkView& paddedView, const uint8_t* faceMasks, int minZ, int maxZ)
+{
+	//faces are only merged within the z range so they never cross into another mesh slice
+	const int rangeMins[3] = { 0, 0, minZ };
+	const int rangeSizes[3] = { CHUNK_SIZE_X, CHUNK_SIZE_Y, maxZ - minZ };
+	constexpr uint32_t faceKeyPresent = 1 << 24;
+
+	//normal axis of every face, in BlockFace order
+	constexpr int faceAxes[NUM_BLOCK_FACES] = { 2, 2, 0, 1, 0, 1 };
+
+	//a face key packs everything that has to match for two faces to be merged: block type (and so texture) and the light of the block in front
+	std::vector<uint32_t> faceKeys;
+	std::vector<MergedFace> mergedFaces;
+	for (int face = 0; face < NUM_BLOCK_FACES; face++)
+	{
+		int normalAxis = faceAxes[face];
+		int axisA = normalAxis == 0 ? 1 : 0;
+		int axisB = normalAxis == 2 ? 1 : 2;
+		int sizeA = rangeSizes[axisA];
+		int sizeB = rangeSizes[axisB];
+		int neighbourStep = FACE_NEIGHBOUR_STEPS[face];
+		faceKeys.assign(sizeA * sizeB, 0);
+
+		for (int layer = rangeMins[normalAxis]; layer < rangeMins[normalAxis] + rangeSizes[normalAxis]; layer++)
+		{
+			//build the mask of exposed faces in this layer
+			for (int b = 0; b < sizeB; b++)
+			{
+				for (int a = 0; a < sizeA; a++)
+				{
+					int coords[3];
+					coords[normalAxis] = layer;
+					coords[axisA] = rangeMins[axisA] + a;
+					coords[axisB] = rangeMins[axisB] + b;
+					IntVec3 localCoords(coords[0], coords[1], coords[2]);
+					int blockIndex = Chunk::GetBlockIndexFromLocalCoords(localCoords);
+					uint8_t faceMask = faceMasks[blockIndex];
+					uint32_t faceKey = 0;
+					//only cubes are merged, water and shaped blocks go through their own kernels
+					if ((faceMask & (1 << face)) && (faceMask & (FACE_MASK_WATER | FACE_MASK_SHAPED)) == 0)
+					{
+						int paddedIndex = PaddedChunkView::GetPaddedIndexFromLocalCoords(localCoords);
+						const Block& block = paddedView.GetBlock(paddedIndex);
+						faceKey = faceKeyPresent | (uint32_t(paddedView.GetBlock(paddedIndex + neighbourStep).m_lightInfluence) << 8) | block.m_typeIndex;
+					}
+					faceKeys[a + (b * sizeA)] = faceKey;
+				}
+			}
+
+			MergeFaceKeys(faceKeys, sizeA, sizeB, mergedFaces);
+			for (int i = 0; i < (int)mergedFaces.size(); i++)
+			{
+				const MergedFace& mergedFace = mergedFaces[i];
+				int minCoords[3];
+				minCoords[normalAxis] = layer;
+				minCoords[axisA] = rangeMins[axisA] + mergedFace.m_minA;
+				minCoords[axisB] = rangeMins[axisB] + mergedFace.m_minB;
+				int maxCoords[3];
+				maxCoords[normalAxis] = layer + 1;
+				maxCoords[axisA] = minCoords[axisA] + mergedFace.m_sizeA;
+				maxCoords[axisB] = minCoords[axisB] + mergedFace.m_sizeB;
+				IntVec3 localMins(minCoords[0], minCoords[1], minCoords[2]);
+				IntVec3 localMaxs(maxCoords[0], maxCoords[1], maxCoords[2]);
+
+				uint32_t faceKey = mergedFace.m_faceKey;
+				const BlockDefintion& blockDef = BlockDefintion::s_definitions[faceKey & 0xFF];
+				Block frontBlock;
+				frontBlock.m_lightInfluence = uint8_t((faceKey >> 8) & 0xFF);
+				AddVertsForFace(meshData.m_opaquePackedVertices, localMins, localMaxs, BlockFace(face), frontBlock,
+					GetFaceSpriteIndex(blockDef, BlockFace(face)), CHUNK_VERTEX_FLAG_TILED_UVS);
+			}
+		}
+	}
+}
+
+void ChunkMesher::MergeFaceKeys(std::vector<uint32_t>& faceKeys, int sizeA, int sizeB, std::vector<MergedFace>& out_mergedFaces)
+{
+	out_mergedFaces.clear();
+
+	//grow each face as far as it goes along a, then along b while the whole row matches
+	for (int b = 0; b < sizeB; b++)
+	{
+		for (int a = 0; a < sizeA; )
+		{
+			uint32_t faceKey = faceKeys[a + (b * sizeA)];
+			if (faceKey == 0)
+			{
+				a++;
+				continue;
+			}
+
+			int width = 1;
+			while (a + width < sizeA && faceKeys[a + width + (b * sizeA)] == faceKey)
+				width++;
+
+			int height = 1;
+			bool canGrow = true;
+			while (b + height < sizeB && canGrow)
+			{
+				for (int i = 0; i < width; i++)
+				{
+					if (faceKeys[a + i + ((b + height) * sizeA)] != faceKey)
+					{
+						canGrow = false;
+						break;
+					}
+				}
+				if (canGrow)
+					height++;
+			}
+
+			for (int j = 0; j < height; j++)
+			{
+				for (int i = 0; i < width; i++)
+				{
+					faceKeys[a + i + ((b + j) * sizeA)] = 0;
+				}
+			}
+
+			MergedFace mergedFace;
+			mergedFace.m_minA = a;
+			mergedFace.m_minB = b;
+			mergedFace.m_sizeA = width;
+			mergedFace.m_sizeB = height;
+			mergedFace.m_faceKey = faceKey;
+			out_mergedFaces.push_back(mergedFace);
+
+			a += width;
+		}
+	}
+}
+
+void ChunkMesher::AddVertsForFace(std::vector<ChunkVertex>& verts, const IntVec3& localMins, const IntVec3& localMaxs, BlockFace face,
+	const Block& frontBlock, uint16_t spriteIndex, uint8_t flags)
+{
+	//faces are lit by the block in front of them
+	uint8_t outdoorLight = frontBlock.GetOutdoorLightInfluence();
+	uint8_t indoorLight = frontBlock.GetIndoorLightInfluence();
+
+	for (int corner = 0; corner < NUM_FACE_CORNERS; corner++)
+	{
+		const bool* atMaxs = FACE_CORNER_AT_MAXS[face][corner];
+		IntVec3 cornerPosition(atMaxs[0] ? localMaxs.x : localMins.x, atMaxs[1] ? localMaxs.y : localMins.y, atMaxs[2] ? localMaxs.z : localMins.z);
+		verts.emplace_back(cornerPosition, face, FaceCorner(corner), flags, spriteIndex, outdoorLight, indoorLight);
+	}
+}
+
+void ChunkMesher::AddVertsForShapedBlock(ChunkMeshData& meshData, const BlockShapeContext& context, const BlockDefintion& blockDef, const IntVec3& localCoords, int paddedIndex, uint8_t faceMask)
+{
+	switch (blockDef.m_shape)
+	{
+	case BLOCK_SHAPE_FLUID:		BlockShapeKernel<BLOCK_SHAPE_FLUID>::AddVerts(meshData, context, blockDef, localCoords, paddedIndex, faceMask);	break;
+	case BLOCK_SHAPE_CROSS:		BlockShapeKernel<BLOCK_SHAPE_CROSS>::AddVerts(meshData, context, blockDef, localCoords, paddedIndex, faceMask);	break;
+	case BLOCK_SHAPE_SLAB:		BlockShapeKernel<BLOCK_SHAPE_SLAB>::AddVerts(meshData, context, blockDef, localCoords, paddedIndex, faceMask);	break;
+	case BLOCK_SHAPE_MODEL:		BlockShapeKernel<BLOCK_SHAPE_MODEL>::AddVerts(meshData, context, blockDef, localCoords, paddedIndex, faceMask);	break;
+	default:																																		break;
+	}
+}
+
+void ChunkMesher::AddVertsForSubBlockFace(std::vector<ChunkVertex>& verts, const IntVec3& localCoords, const IntVec3& boxMins, const IntVec3& boxMaxs, BlockFace face,
+	const Block& lightBlock, uint16_t spriteIndex, uint8_t flags)
+{
+	IntVec3 corners[NUM_FACE_CORNERS];
+	for (int corner = 0; corner < NUM_FACE_CORNERS; corner++)
+	{
+		const bool* atMaxs = FACE_CORNER_AT_MAXS[face][corner];
+		corners[corner] = IntVec3((localCoords.x * BLOCK_MODEL_UNITS) + (atMaxs[0] ? boxMaxs.x : boxMins.x), (localCoords.y * BLOCK_MODEL_UNITS) + (atMaxs[1] ? boxMaxs.y : boxMins.y),
+			(localCoords.z * BLOCK_MODEL_UNITS) + (atMaxs[2] ? boxMaxs.z : boxMins.z));
+	}
+	AddVertsForQuad(verts, corners, face, lightBlock, spriteIndex, flags);
+}
+
+void ChunkMesher::AddVertsForQuad(std::vector<ChunkVertex>& verts, const IntVec3* cornersSixteenths, BlockFace face, const Block& lightBlock, uint16_t spriteIndex, uint8_t flags)
+{
+	uint8_t outdoorLight = lightBlock.GetOutdoorLightInfluence();
+	uint8_t indoorLight = lightBlock.GetIndoorLightInfluence();
+	for (int corner = 0; corner < NUM_FACE_CORNERS; corner++)
+	{
+		const IntVec3& position = cornersSixteenths[corner];
+		ChunkVertex vertex(IntVec3(position.x / BLOCK_MODEL_UNITS, position.y / BLOCK_MODEL_UNITS, position.z / BLOCK_MODEL_UNITS), face, FaceCorner(corner), flags, spriteIndex, outdoorLight, indoorLight);
+		vertex.SetSubBlockOffset(IntVec3(position.x % BLOCK_MODEL_UNITS, position.y % BLOCK_MODEL_UNITS, position.z % BLOCK_MODEL_UNITS));
+		verts.push_back(vertex);
+	}
+}
+
+uint16_t ChunkMesher::GetFaceSpriteIndex(const BlockDefintion& blockDef, BlockFace face)
+{
+	if (face == BLOCK_FACE_TOP)
+		return blockDef.m_topSpriteIndex;
+	if (face == BLOCK_FACE_BOTTOM)
+		return blockDef.m_bottomSpriteIndex;
+
+	return blockDef.m_sideSpriteIndex;
+}
+
+ChunkMeshJob::ChunkMeshJob(const ChunkHandle& chunkHandle, const ChunkMeshInput& input)
+	:m_chunkHandle(chunkHandle), m_input(input)
+{
+}
+
+void ChunkMeshJob::Execute()
+{
+	double startTime = GetCurrentTimeSeconds();
+	//the file is only read here, the chunk's save jobs write it
+	m_loadedMeshCache = m_input.m_loadedMeshCache;
+	if (m_input.m_useMeshCache && !m_input.m_meshCacheFilePath.empty())
+	{
+		ChunkMeshCache* loadedMeshCache = new ChunkMeshCache(m_input.m_meshCacheFilePath);
+		if (loadedMeshCache->LoadFromFile())
+			m_loadedMeshCache.reset(loadedMeshCache);
+		else
+			delete loadedMeshCache;
+	}
+	m_numCachedSlices = ChunkMesher::BuildMesh(m_input, m_loadedMeshCache.get(), m_sliceKeys, m_meshSlices);
+	for (int slice = 0; slice < CHUNK_NUM_MESH_SLICES && m_input.m_decodeToPCU; slice++)
+	{
+		if (m_input.m_meshSlices & (1u << slice))
+			ChunkMesher::DecodeMeshToPCU(m_meshSlices[slice], m_input.m_chunkWorldMins);
+	}
+	m_meshTimeMs = float((GetCurrentTimeSeconds() - startTime) * 1000.0);
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <vector>
+#include "Engine/Core/Vertex_PCU.hpp"
+#include "Engine/Core/Job.hpp"
+#include "Game/Chunk.hpp"
+#include "Game/ChunkVertex.hpp"
+
+class PaddedChunkView;
+class ChunkMeshCache;
+
+constexpr uint8_t FACE_MASK_WATER = 0x40;
+constexpr uint8_t FACE_MASK_SHAPED = 0x80;		//block that is neither a cube nor a fluid, meshed by its shape's kernel
+
+enum ChunkMesherType
+{
+	CHUNK_MESHER_PER_BLOCK,		//one quad per exposed face
+	CHUNK_MESHER_GREEDY			//merges coplanar faces with the same texture and light, the merged faces are tiled by the world shader
+};
+
+//snapshots of a chunk and its four neighbours, everything needed to build the chunk's mesh away from the main thread
+struct ChunkMeshInput
+{
+public:
+	ChunkSnapshot m_chunk;
+	ChunkSnapshot m_eastNeighbour;
+	ChunkSnapshot m_westNeighbour;
+	ChunkSnapshot m_northNeighbour;
+	ChunkSnapshot m_southNeighbour;
+	Vec3 m_chunkWorldMins = Vec3::ZERO;
+	ChunkMesherType m_mesherType = CHUNK_MESHER_PER_BLOCK;
+	uint32_t m_meshSlices = ALL_CHUNK_MESH_SLICES;		//bit per mesh slice to build, the others are left untouched
+	bool m_decodeToPCU = false;		//the chunks are drawn with a shader that can not decode packed vertices, so the job decodes them to Vertex_PCU
+	bool m_useMeshCache = false;		//every built slice is hashed, the chunk keeps the keys to write its mesh cache file with
+	std::string m_meshCacheFilePath;		//only for the first mesh after the chunk is loaded, the job reads this file
+	std::shared_ptr<const ChunkMeshCache> m_loadedMeshCache;		//the file as the first job read it, slices found unchanged in it are loaded instead of built
+};
+
+//mesh of one slice of a chunk
+//every face is a quad of four vertices in FaceCorner order, so there are no indices, every mesh is drawn with the world's shared quad index buffer
+struct ChunkMeshData
+{
+public:
+	int GetNumVertices() const;
+	size_t GetMemoryBytes() const;
+
+public:
+	std::vector<ChunkVertex> m_opaquePackedVertices;
+	std::vector<ChunkVertex> m_translucentPackedVertices;
+	std::vector<Vertex_PCU> m_opaqueVertices;		//only filled by jobs that decode to Vertex_PCU, which drop the packed vertices
+	std::vector<Vertex_PCU> m_translucentVertices;
+};
+
+//a rectangle of matching face keys found by ChunkMesher::MergeFaceKeys, in the two axes of the layer it was merged in
+struct MergedFace
+{
+public:
+	int m_minA = 0;
+	int m_minB = 0;
+	int m_sizeA = 0;
+	int m_sizeB = 0;
+	uint32_t m_faceKey = 0;
+};
+
+//what every block shape kernel needs besides the block itself
+struct BlockShapeContext
+{
+public:
+	const PaddedChunkView* m_paddedView = nullptr;
+	bool m_mergeWaterSurface = false;	//water top faces are merged separately and skipped by the fluid kernel
+};
+
+//mesh kernel of one block shape, specialised for each shape in ChunkMesher.cpp
+//each shape gets its own compiled loop, so the cube kernel that meshes almost every block never looks at the shape
+template <BlockShape SHAPE>
+struct BlockShapeKernel
+{
+public:
+	static void AddVerts(ChunkMeshData& meshData, const BlockShapeContext& context, const BlockDefintion& blockDef, const IntVec3& localCoords, int paddedIndex, uint8_t faceMask);
+};
+
+class ChunkMesher
+{
+	template <BlockShape SHAPE> friend struct BlockShapeKernel;
+
+public:
+	//fills the entries of out_meshSlices (CHUNK_NUM_MESH_SLICES of them) for the slices in input.m_meshSlices, returns how many of them came from the mesh cache
+	//slices found in loadedMeshCache (can be null) are loaded instead of built, out_sliceKeys gets the mesh cache key of every slice when input.m_useMeshCache is set
+	static int BuildMesh(const ChunkMeshInput& input, const ChunkMeshCache* loadedMeshCache, uint64_t* out_sliceKeys, ChunkMeshData* out_meshSlices);
+	static void DecodeMeshToPCU(ChunkMeshData& meshData, const Vec3& chunkWorldMins);
+	static ChunkMesherType GetMesherTypeFromName(const std::string& name);
+
+	//one byte per block (by block index) for the layers from minZ up to maxZ, bits 0-5 are the exposed faces in BlockFace order,
+	//FACE_MASK_WATER marks fluid blocks and FACE_MASK_SHAPED other non cube blocks with an exposed face
+	static void ComputeFaceMasks(const PaddedChunkView& paddedView, int minZ, int maxZ, uint8_t* out_faceMasks);
+	//crack faces for one block being dug, frontBlocks holds the neighbour in front of each face in BlockFace order (null outside the loaded world)
+	static void AddVertsForDigCrack(std::vector<ChunkVertex>& verts, const IntVec3& localCoords, const Block* const* frontBlocks, uint8_t digState);
+
+private:
+	static void AddVertsForShapedBlock(ChunkMeshData& meshData, const BlockShapeContext& context, const BlockDefintion& blockDef, const IntVec3& localCoords, int paddedIndex, uint8_t faceMask);
+	static void AddVertsForWaterSurfaceGreedy(ChunkMeshData& meshData, const PaddedChunkView& paddedView, const uint8_t* faceMasks, int minZ, int maxZ);
+	static void AddVertsForOpaqueFacesGreedy(ChunkMeshData& meshData, const PaddedChunkView& paddedView, const uint8_t* faceMasks, int minZ, int maxZ);
+	//clears the keys it merges, a key of 0 means there is no face
+	static void MergeFaceKeys(std::vector<uint32_t>& faceKeys, int sizeA, int sizeB, std::vector<MergedFace>& out_mergedFaces);
+	static void AddVertsForFace(std::vector<ChunkVertex>& verts, const IntVec3& localMins, const IntVec3& localMaxs, BlockFace face,
+		const Block& frontBlock, uint16_t spriteIndex, uint8_t flags);
+	//face of a box given in sixteenths of a block, relative to the block at localCoords
+	static void AddVertsForSubBlockFace(std::vector<ChunkVertex>& verts, const IntVec3& localCoords, const IntVec3& boxMins, const IntVec3& boxMaxs, BlockFace face,
+		const Block& lightBlock, uint16_t spriteIndex, uint8_t flags);
+	//quad with corners in sixteenths of a block relative to the chunk, in FaceCorner order
+	static void AddVertsForQuad(std::vector<ChunkVertex>& verts, const IntVec3* cornersSixteenths, BlockFace face, const Block& lightBlock, uint16_t spriteIndex, uint8_t flags);
+	static uint16_t GetFaceSpriteIndex(const BlockDefintion& blockDef, BlockFace face);
+};
+
+class ChunkMeshJob : public Job
+{
+public:
+	ChunkMeshJob(const ChunkHandle& chunkHandle, const ChunkMeshInput& input);
+
+public:
+	ChunkHandle m_chunkHandle;
+	ChunkMeshInput m_input;
+	ChunkMeshData m_meshSlices[CHUNK_NUM_MESH_SLICES];
+	float m_meshTimeMs = 0.f;
+	int m_numCachedSlices = 0;
+	uint64_t m_sliceKeys[CHUNK_NUM_MESH_SLICES] = {};		//mesh cache key of each built slice, 0 without a mesh cache
+	std::shared_ptr<const ChunkMeshCache> m_loadedMeshCache;		//read by this job or handed over by the chunk, null when there is no file to check
+
+private:
+	virtual void Execute() override;
+};
@@ -0,0 +1,145 @@
+#include <math.h>
+#include "Engine/Math/IntVec3.hpp"
+#include "Game/ChunkVertex.hpp"
+#include "Game/Chunk.hpp"
+
+constexpr int POSITION_X_SHIFT = 0;
+constexpr int POSITION_Y_SHIFT = 6;
+constexpr int POSITION_Z_SHIFT = 12;
+constexpr int FACE_SHIFT = 21;
+constexpr int CORNER_SHIFT = 24;
+constexpr int FLAGS_SHIFT = 26;
+constexpr uint32_t POSITION_XY_MASK = 0x3F;
+constexpr uint32_t POSITION_Z_MASK = 0x1FF;
+constexpr uint32_t FACE_MASK = 0x7;
+constexpr uint32_t CORNER_MASK = 0x3;
+constexpr uint32_t FLAGS_MASK = 0x3F;
+
+constexpr int SPRITE_SHIFT = 0;
+constexpr int OUTDOOR_LIGHT_SHIFT = 12;
+constexpr int INDOOR_LIGHT_SHIFT = 16;
+constexpr uint32_t SPRITE_MASK = 0xFFF;
+constexpr uint32_t LIGHT_MASK = 0xF;
+constexpr int SUB_BLOCK_X_SHIFT = 20;
+constexpr int SUB_BLOCK_Y_SHIFT = 24;
+constexpr int SUB_BLOCK_Z_SHIFT = 28;
+constexpr uint32_t SUB_BLOCK_MASK = 0xF;
+
+static_assert(CHUNK_SIZE_X <= 63 && CHUNK_SIZE_Y <= 63 && CHUNK_SIZE_Z <= 511, "Chunk is too big for the packed chunk vertex position");
+
+ChunkVertex::ChunkVertex(const IntVec3& localPosition, BlockFace face, FaceCorner corner, uint8_t flags, uint16_t spriteIndex, uint8_t outdoorLight, uint8_t indoorLight)
+{
+	m_positionAndFace = (uint32_t(localPosition.x) & POSITION_XY_MASK) << POSITION_X_SHIFT
+		| (uint32_t(localPosition.y) & POSITION_XY_MASK) << POSITION_Y_SHIFT
+		| (uint32_t(localPosition.z) & POSITION_Z_MASK) << POSITION_Z_SHIFT
+		| (uint32_t(face) & FACE_MASK) << FACE_SHIFT
+		| (uint32_t(corner) & CORNER_MASK) << CORNER_SHIFT
+		| (uint32_t(flags) & FLAGS_MASK) << FLAGS_SHIFT;
+	m_spriteAndLight = (uint32_t(spriteIndex) & SPRITE_MASK) << SPRITE_SHIFT
+		| (uint32_t(outdoorLight) & LIGHT_MASK) << OUTDOOR_LIGHT_SHIFT
+		| (uint32_t(indoorLight) & LIGHT_MASK) << INDOOR_LIGHT_SHIFT;
+}
+
+void ChunkVertex::SetSubBlockOffset(const IntVec3& offsetSixteenths)
+{
+	m_spriteAndLight &= ~((SUB_BLOCK_MASK << SUB_BLOCK_X_SHIFT) | (SUB_BLOCK_MASK << SUB_BLOCK_Y_SHIFT) | (SUB_BLOCK_MASK << SUB_BLOCK_Z_SHIFT));
+	m_spriteAndLight |= (uint32_t(offsetSixteenths.x) & SUB_BLOCK_MASK) << SUB_BLOCK_X_SHIFT
+		| (uint32_t(offsetSixteenths.y) & SUB_BLOCK_MASK) << SUB_BLOCK_Y_SHIFT
+		| (uint32_t(offsetSixteenths.z) & SUB_BLOCK_MASK) << SUB_BLOCK_Z_SHIFT;
+}
+
+IntVec3 ChunkVertex::GetLocalPosition() const
+{
+	return IntVec3(int((m_positionAndFace >> POSITION_X_SHIFT) & POSITION_XY_MASK), int((m_positionAndFace >> POSITION_Y_SHIFT) & POSITION_XY_MASK),
+		int((m_positionAndFace >> POSITION_Z_SHIFT) & POSITION_Z_MASK));
+}
+
+IntVec3 ChunkVertex::GetSubBlockOffset() const
+{
+	return IntVec3(int((m_spriteAndLight >> SUB_BLOCK_X_SHIFT) & SUB_BLOCK_MASK), int((m_spriteAndLight >> SUB_BLOCK_Y_SHIFT) & SUB_BLOCK_MASK),
+		int((m_spriteAndLight >> SUB_BLOCK_Z_SHIFT) & SUB_BLOCK_MASK));
+}
+
+BlockFace ChunkVertex::GetFace() const
+{
+	return BlockFace((m_positionAndFace >> FACE_SHIFT) & FACE_MASK);
+}
+
+FaceCorner ChunkVertex::GetCorner() const
+{
+	return FaceCorner((m_positionAndFace >> CORNER_SHIFT) & CORNER_MASK);
+}
+
+uint8_t ChunkVertex::GetFlags() const
+{
+	return uint8_t((m_positionAndFace >> FLAGS_SHIFT) & FLAGS_MASK);
+}
+
+uint16_t ChunkVertex::GetSpriteIndex() const
+{
+	return uint16_t((m_spriteAndLight >> SPRITE_SHIFT) & SPRITE_MASK);
+}
+
+uint8_t ChunkVertex::GetOutdoorLight() const
+{
+	return uint8_t((m_spriteAndLight >> OUTDOOR_LIGHT_SHIFT) & LIGHT_MASK);
+}
+
+uint8_t ChunkVertex::GetIndoorLight() const
+{
+	return uint8_t((m_spriteAndLight >> INDOOR_LIGHT_SHIFT) & LIGHT_MASK);
+}
+
+//where a point sits on a face's sprite in blocks, u runs left to right and v bottom to top as seen from outside the face, World.hlsl does the same
+static Vec2 GetFaceUVInBlocks(BlockFace face, const Vec3& position)
+{
+	switch (face)
+	{
+	case BLOCK_FACE_BOTTOM:	return Vec2(-position.y, -position.x);
+	case BLOCK_FACE_TOP:	return Vec2(-position.y, position.x);
+	case BLOCK_FACE_WEST:	return Vec2(-position.y, position.z);
+	case BLOCK_FACE_SOUTH:	return Vec2(position.x, position.z);
+	case BLOCK_FACE_EAST:	return Vec2(position.y, position.z);
+	case BLOCK_FACE_NORTH:	return Vec2(-position.x, position.z);
+	default:				return Vec2();
+	}
+}
+
+Vertex_PCU ChunkVertex::DecodeToPCU(const Vec3& chunkWorldMins) const
+{
+	static const Vec3 faceNormals[NUM_BLOCK_FACES] = { Vec3(0.f, 0.f, -1.f), Vec3(0.f, 0.f, 1.f), Vec3(-1.f, 0.f, 0.f), Vec3(0.f, -1.f, 0.f), Vec3(1.f, 0.f, 0.f), Vec3(0.f, 1.f, 0.f) };
+
+	uint8_t flags = GetFlags();
+	Vec3 localPosition = Vec3(GetLocalPosition()) + Vec3(GetSubBlockOffset()) * (1.f / float(BLOCK_MODEL_UNITS));
+	Vec3 position = chunkWorldMins + localPosition;
+	if (flags & CHUNK_VERTEX_FLAG_CRACK_OVERLAY)
+	{
+		position += faceNormals[GetFace()] * CHUNK_VERTEX_CRACK_OFFSET;
+	}
+
+	//light nibbles map 0-15 onto 0-255
+	Rgba8 color;
+	color.r = uint8_t(GetOutdoorLight() * 17);
+	color.g = uint8_t(GetIndoorLight() * 17);
+	color.b = (flags & CHUNK_VERTEX_FLAG_WAVE) ? 255 : 0;
+	color.a = (flags & CHUNK_VERTEX_FLAG_TRANSLUCENT) ? 127 : 255;
+
+	const AABB2& spriteUVs = BlockDefintion::GetSpriteUVs(GetSpriteIndex());
+	FaceCorner corner = GetCorner();
+	bool isRight = corner == FACE_CORNER_BOTTOM_RIGHT || corner == FACE_CORNER_TOP_RIGHT;
+	bool isTop = corner == FACE_CORNER_TOP_LEFT || corner == FACE_CORNER_TOP_RIGHT;
+	Vec2 spriteFraction(isRight ? 1.f : 0.f, isTop ? 1.f : 0.f);
+	if (flags & CHUNK_VERTEX_FLAG_TILED_UVS)
+	{
+		//the corner's place within its block, a corner on a block boundary is the sprite's edge on its own side of the face
+		Vec2 faceUV = GetFaceUVInBlocks(GetFace(), localPosition);
+		spriteFraction.x = faceUV.x - floorf(faceUV.x);
+		spriteFraction.y = faceUV.y - floorf(faceUV.y);
+		if (spriteFraction.x == 0.f && isRight)
+			spriteFraction.x = 1.f;
+		if (spriteFraction.y == 0.f && isTop)
+			spriteFraction.y = 1.f;
+	}
+	Vec2 uv(spriteUVs.m_mins.x + spriteFraction.x * (spriteUVs.m_maxs.x - spriteUVs.m_mins.x), spriteUVs.m_mins.y + spriteFraction.y * (spriteUVs.m_maxs.y - spriteUVs.m_mins.y));
+	return Vertex_PCU(position, color, uv);
+}
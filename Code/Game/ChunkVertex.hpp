@@ -0,0 +1,82 @@
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include "Engine/Core/Vertex_PCU.hpp"
+#include "Engine/Math/IntVec3.hpp"
+
+enum BlockFace
+{
+	BLOCK_FACE_BOTTOM,
+	BLOCK_FACE_TOP,
+	BLOCK_FACE_WEST,	//-x
+	BLOCK_FACE_SOUTH,	//-y
+	BLOCK_FACE_EAST,	//+x
+	BLOCK_FACE_NORTH,	//+y
+	NUM_BLOCK_FACES
+};
+
+//corners of a face in the order they are emitted, uvs go from (0,0) at the bottom left to (1,1) at the top right
+enum FaceCorner
+{
+	FACE_CORNER_TOP_LEFT,
+	FACE_CORNER_BOTTOM_LEFT,
+	FACE_CORNER_BOTTOM_RIGHT,
+	FACE_CORNER_TOP_RIGHT,
+	NUM_FACE_CORNERS
+};
+
+//for every face the corners in FaceCorner order, each as whether it sits on the max side of the face's box along x, y and z
+//top left/bottom left/bottom right/top right as seen from outside the face, so the quad winds counter clockwise
+constexpr bool FACE_CORNER_AT_MAXS[NUM_BLOCK_FACES][NUM_FACE_CORNERS][3] =
+{
+	{ { false, true, false }, { true, true, false }, { true, false, false }, { false, false, false } },		//bottom
+	{ { true, true, true }, { false, true, true }, { false, false, true }, { true, false, true } },			//top
+	{ { false, true, true }, { false, true, false }, { false, false, false }, { false, false, true } },		//west
+	{ { false, false, true }, { false, false, false }, { true, false, false }, { true, false, true } },		//south
+	{ { true, false, true }, { true, false, false }, { true, true, false }, { true, true, true } },			//east
+	{ { true, true, true }, { true, true, false }, { false, true, false }, { false, true, true } },			//north
+};
+
+constexpr uint8_t CHUNK_VERTEX_FLAG_WAVE = 0x01;			//top surface of the sea, animated in the vertex shader
+constexpr uint8_t CHUNK_VERTEX_FLAG_TRANSLUCENT = 0x02;		//drawn at half alpha
+constexpr uint8_t CHUNK_VERTEX_FLAG_TILED_UVS = 0x04;		//face is not one whole block, the sprite is repeated once per block along the face
+constexpr uint8_t CHUNK_VERTEX_FLAG_CRACK_OVERLAY = 0x08;	//dig crack, pushed slightly off the face it covers
+
+constexpr float CHUNK_VERTEX_CRACK_OFFSET = 0.01f;
+
+//8 byte chunk vertex the meshers build, the mesh cache keeps and the gpu draws, World.hlsl decodes it in the vertex shader
+//the engine only binds the Vertex_PCU input layout, so the buffers are made with an 8 byte stride and the shader reads the two words as the bits of position x and y
+//m_positionAndFace: [6(flags)2(corner)3(face)9(z)6(y)6(x)], position is the corner in chunk local block coordinates
+//m_spriteAndLight:  [4(z)4(y)4(x)4(indoor light)4(outdoor light)12(sprite index)], x/y/z are the sub block offset of the corner in sixteenths of a block
+struct ChunkVertex
+{
+public:
+	uint32_t m_positionAndFace = 0;
+	uint32_t m_spriteAndLight = 0;
+
+public:
+	ChunkVertex() = default;
+	ChunkVertex(const IntVec3& localPosition, BlockFace face, FaceCorner corner, uint8_t flags, uint16_t spriteIndex, uint8_t outdoorLight, uint8_t indoorLight);
+
+	//shaped blocks put corners between block corners, the offset is added on top of the local position
+	void SetSubBlockOffset(const IntVec3& offsetSixteenths);
+
+	IntVec3 GetLocalPosition() const;
+	IntVec3 GetSubBlockOffset() const;
+	BlockFace GetFace() const;
+	FaceCorner GetCorner() const;
+	uint8_t GetFlags() const;
+	uint16_t GetSpriteIndex() const;
+	uint8_t GetOutdoorLight() const;
+	uint8_t GetIndoorLight() const;
+
+	//reference decode of what World.hlsl does, produces the same vertex the per block mesher used to emit as Vertex_PCU
+	//only used when the chunks are drawn with the default shader, which can not decode the packed vertex
+	//a tiled face gets the part of the sprite its corner covers, which is only right for faces no bigger than a block
+	Vertex_PCU DecodeToPCU(const Vec3& chunkWorldMins) const;
+};
+static_assert(sizeof(ChunkVertex) == 8, "ChunkVertex should be 8 bytes");
+static_assert(offsetof(ChunkVertex, m_positionAndFace) == 0 && offsetof(ChunkVertex, m_spriteAndLight) == 4, "World.hlsl reads the packed words as position x and y");
+
+//the Vertex_PCU input layout reads a whole Vertex_PCU from the start of every vertex, so the last packed vertex needs this much room after it
+constexpr size_t CHUNK_VERTEX_BUFFER_PADDING = sizeof(Vertex_PCU) - sizeof(ChunkVertex);
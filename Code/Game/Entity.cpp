@@ -141,6 +141,20 @@ void Entity::CollideWithWorld()
 	if (!currentChunk)
 		return;
 
+	//nothing to push out of while the entity is above the highest opaque block of every column it checks against
+	int highestOpaqueZ = -1;
+	for (int y = -1; y <= 1; y++)
+	{
+		for (int x = -1; x <= 1; x++)
+		{
+			int columnHighestOpaqueZ = m_world->GetZHeightOfHighestOpaqueBlock(Vec2(m_position.x + float(x), m_position.y + float(y)));
+			if (columnHighestOpaqueZ > highestOpaqueZ)
+				highestOpaqueZ = columnHighestOpaqueZ;
+		}
+	}
+	if (m_position.z > float(highestOpaqueZ + 1))
+		return;
+
 	Vec3 boundsMins = currentChunk->GetChunkWorldBounds().m_mins;
 	IntVec3 localCoords = IntVec3(int(m_position.x - boundsMins.x), int(m_position.y - boundsMins.y), int(m_position.z + 0.6f));
 	int blockIndex = Chunk::GetBlockIndexFromLocalCoords(localCoords);
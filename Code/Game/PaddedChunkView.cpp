@@ -0,0 +1,63 @@
+#include <cstring>
+#include "Engine/Math/IntVec3.hpp"
+#include "Game/PaddedChunkView.hpp"
+
+void PaddedChunkView::Populate(const ChunkBlockData& chunk, const ChunkBlockData* eastNeighbour, const ChunkBlockData* westNeighbour,
+	const ChunkBlockData* northNeighbour, const ChunkBlockData* southNeighbour)
+{
+	//copy the chunk itself one row at a time
+	for (int z = 0; z < CHUNK_SIZE_Z; z++)
+	{
+		for (int y = 0; y < CHUNK_SIZE_Y; y++)
+		{
+			const Block* sourceRow = &chunk.m_blocks[Chunk::GetBlockIndexFromLocalCoords(IntVec3(0, y, z))];
+			Block* destRow = &m_blocks[GetPaddedIndexFromLocalCoords(IntVec3(0, y, z))];
+			memcpy(destRow, sourceRow, sizeof(Block) * CHUNK_SIZE_X);
+		}
+	}
+
+	//x and y borders come from the neighbouring chunks
+	CopyBorderFromNeighbour(eastNeighbour, CHUNK_SIZE_X, 0, 0, 0, false);
+	CopyBorderFromNeighbour(westNeighbour, -1, 0, CHUNK_MAX_X, 0, false);
+	CopyBorderFromNeighbour(northNeighbour, 0, CHUNK_SIZE_Y, 0, 0, true);
+	CopyBorderFromNeighbour(southNeighbour, 0, -1, 0, CHUNK_MAX_Y, true);
+
+	//the blocks above the top layer and below the bottom layer are the blocks themselves, which matches BlockIterator
+	memcpy(&m_blocks[0], &m_blocks[PADDED_STEP_Z], sizeof(Block) * PADDED_BLOCKS_PER_LAYER);
+	memcpy(&m_blocks[(PADDED_SIZE_Z - 1) * PADDED_STEP_Z], &m_blocks[(PADDED_SIZE_Z - 2) * PADDED_STEP_Z], sizeof(Block) * PADDED_BLOCKS_PER_LAYER);
+}
+
+int PaddedChunkView::GetPaddedIndexFromLocalCoords(const IntVec3& localCoords)
+{
+	return (localCoords.x + 1) + ((localCoords.y + 1) * PADDED_STEP_Y) + ((localCoords.z + 1) * PADDED_STEP_Z);
+}
+
+int PaddedChunkView::GetPaddedIndexFromBlockIndex(int blockIndex)
+{
+	int x = blockIndex & CHUNK_MAX_X;
+	int y = (blockIndex >> CHUNK_BITS_X) & CHUNK_MAX_Y;
+	int z = blockIndex >> (CHUNK_BITS_X + CHUNK_BITS_Y);
+	return GetPaddedIndexFromLocalCoords(IntVec3(x, y, z));
+}
+
+void PaddedChunkView::CopyBorderFromNeighbour(const ChunkBlockData* neighbour, int borderX, int borderY, int neighbourX, int neighbourY, bool alongX)
+{
+	int borderLength = alongX ? CHUNK_SIZE_X : CHUNK_SIZE_Y;
+	for (int z = 0; z < CHUNK_SIZE_Z; z++)
+	{
+		for (int i = 0; i < borderLength; i++)
+		{
+			IntVec3 borderCoords = alongX ? IntVec3(i, borderY, z) : IntVec3(borderX, i, z);
+			Block& borderBlock = m_blocks[GetPaddedIndexFromLocalCoords(borderCoords)];
+			if (neighbour)
+			{
+				IntVec3 neighbourCoords = alongX ? IntVec3(i, neighbourY, z) : IntVec3(neighbourX, i, z);
+				borderBlock = neighbour->m_blocks[Chunk::GetBlockIndexFromLocalCoords(neighbourCoords)];
+			}
+			else
+			{
+				borderBlock = m_missingNeighbourBlock;
+			}
+		}
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "Game/Chunk.hpp"
+
+//a chunk plus a one block border on every side, laid out so that every block inside the chunk can reach all
+//six of its neighbours with a constant index step and no branches
+constexpr int PADDED_SIZE_X = CHUNK_SIZE_X + 2;
+constexpr int PADDED_SIZE_Y = CHUNK_SIZE_Y + 2;
+constexpr int PADDED_SIZE_Z = CHUNK_SIZE_Z + 2;
+constexpr int PADDED_BLOCKS_PER_LAYER = PADDED_SIZE_X * PADDED_SIZE_Y;
+constexpr int PADDED_TOTAL_BLOCKS = PADDED_BLOCKS_PER_LAYER * PADDED_SIZE_Z;
+
+constexpr int PADDED_STEP_X = 1;
+constexpr int PADDED_STEP_Y = PADDED_SIZE_X;
+constexpr int PADDED_STEP_Z = PADDED_BLOCKS_PER_LAYER;
+
+class PaddedChunkView
+{
+public:
+	PaddedChunkView() = default;
+	//neighbours may be null, their border is then filled with m_missingNeighbourBlock
+	void Populate(const ChunkBlockData& chunk, const ChunkBlockData* eastNeighbour, const ChunkBlockData* westNeighbour,
+		const ChunkBlockData* northNeighbour, const ChunkBlockData* southNeighbour);
+	const Block& GetBlock(int paddedIndex) const { return m_blocks[paddedIndex]; }
+	bool IsBlockOpaque(int paddedIndex) const { return BlockDefintion::IsBlockTypeOpaque(m_blocks[paddedIndex].m_typeIndex); }
+
+	//local coords range from -1 to CHUNK_SIZE on each axis
+	static int GetPaddedIndexFromLocalCoords(const IntVec3& localCoords);
+	static int GetPaddedIndexFromBlockIndex(int blockIndex);
+
+public:
+	//block used for the x/y border when a neighbouring chunk is not present
+	Block m_missingNeighbourBlock;
+
+private:
+	Block m_blocks[PADDED_TOTAL_BLOCKS];
+
+private:
+	void CopyBorderFromNeighbour(const ChunkBlockData* neighbour, int borderX, int borderY, int neighbourX, int neighbourY, bool alongX);
+};
@@ -5,6 +5,8 @@
 #include "Engine/Math/MathUtils.hpp"
 #include "Engine/Input/InputSystem.hpp"
 #include "Engine/Renderer/ConstantBuffer.hpp"
+#include "Engine/Renderer/IndexBuffer.hpp"
+#include "Engine/Renderer/VertexBuffer.hpp"
 #include "Engine/Core/ErrorWarningAssert.hpp"
 #include "Engine/Math/IntVec3.hpp"
 #include "ThirdParty/Squirrel/SmoothNoise.hpp"
@@ -27,6 +29,9 @@ extern JobSystem* g_theJobSystem;
 
 constexpr int gameConstantsSlotNumber = 4;
 constexpr float raycastDistance = 8.f;
+//blocks with a shape of their own are picked with 0, the number keys only reach the first nine block types
+const char* const SHAPED_BLOCK_NAMES[] = { "stone slab", "tall grass", "fence post" };
+constexpr int NUM_SHAPED_BLOCK_NAMES = sizeof(SHAPED_BLOCK_NAMES) / sizeof(SHAPED_BLOCK_NAMES[0]);
 
 struct GameConstants
 {
@@ -38,22 +43,34 @@ struct GameConstants
 	float fogEndDistance;
 	float fogMaxAlpha;
 	float worldTime;
+	float blockTileUVSize[2];
+	float spriteUVOrigin[2];
+	float spriteUVStep[2];
+	float spriteSheetWidth;
+	float padding;
 };
 
 World::World(Game* game)
 	:m_game(game)
 {
+	BlockModel::InitializeModels("Data/Definitions/BlockModels.xml");
 	BlockDefintion::CreateAllDefintions();
 	BlockTemplate::InitializeTemplates("Data/Definitions/BlockTemplates.xml");
 	m_debugStepLighting = g_gameConfigBlackboard.GetValue("debugStepLighting", m_debugStepLighting);
 	bool useDefaultShader = g_gameConfigBlackboard.GetValue("debugUseDefaultShader", false);
 	if (useDefaultShader)
+	{
 		m_shader = g_theRenderer->CreateOrGetShader("Default");
+		m_usePackedChunkVertices = false;
+	}
 	else
 	{
 		std::string shaderName = g_gameConfigBlackboard.GetValue("worldShaderName", "Default");
 		m_shader = g_theRenderer->CreateOrGetShader(shaderName.c_str());
 	}
+	//the dig overlay always goes through the world shader, even when the chunks debug draw with the default one
+	std::string digCrackShaderName = g_gameConfigBlackboard.GetValue("worldShaderName", "Default");
+	m_digCrackOverlayShader = g_theRenderer->CreateOrGetShader(digCrackShaderName.c_str());
 	m_indoorLightColor = g_gameConfigBlackboard.GetValue("indoorLightColor", Rgba8::WHITE);
 	m_dayOutdoorLightColor = g_gameConfigBlackboard.GetValue("dayOutdoorLightColor", Rgba8::WHITE);
 	m_nightOutdoorLightColor = g_gameConfigBlackboard.GetValue("nightOutdoorLightColor", Rgba8::WHITE);
@@ -64,6 +81,21 @@ World::World(Game* game)
 	m_fogEndDistance = g_gameConfigBlackboard.GetValue("fogEnd", m_fogEndDistance);
 	m_fogMaxAlpha = g_gameConfigBlackboard.GetValue("fogMaxAlpha", m_fogMaxAlpha);
 	m_worldSeed = g_gameConfigBlackboard.GetValue("worldSeed", m_worldSeed);
+	m_maxMeshJobsInFlight = g_gameConfigBlackboard.GetValue("maxChunkMeshJobsInFlight", m_maxMeshJobsInFlight);
+	m_chunkMeshBudgetMs = g_gameConfigBlackboard.GetValue("chunkMeshBudgetMs", m_chunkMeshBudgetMs);
+	m_lightingBudgetMs = g_gameConfigBlackboard.GetValue("lightingBudgetMs", m_lightingBudgetMs);
+	m_chunkMesherType = ChunkMesher::GetMesherTypeFromName(g_gameConfigBlackboard.GetValue("chunkMesher", "perBlock"));
+	//the default shader has no tiling, so its chunks keep to faces no bigger than a block, which the decoded vertices can show
+	if (!m_usePackedChunkVertices)
+	{
+		m_chunkMesherType = CHUNK_MESHER_PER_BLOCK;
+	}
+	m_useChunkMeshCache = g_gameConfigBlackboard.GetValue("useChunkMeshCache", m_useChunkMeshCache);
+	//chunks decoded to Vertex_PCU drop their packed vertices, so there would be nothing to write to the mesh cache
+	if (!m_usePackedChunkVertices)
+	{
+		m_useChunkMeshCache = false;
+	}
 
 	m_chunkActivationRange = g_gameConfigBlackboard.GetValue("chunkActivationRange", m_chunkActivationRange);
 	m_chunkDeactivationRange = m_chunkActivationRange + CHUNK_SIZE_X + CHUNK_SIZE_Y;
@@ -72,9 +104,12 @@ World::World(Game* game)
 	m_maxChunks = (2 * m_maxChunkRadiusX) * (2 * m_maxChunkRadiusY);
 
 	m_gameCBO = g_theRenderer->CreateConstantBuffer(sizeof(GameConstants));
+	int chunkMeshMemoryBudgetMB = g_gameConfigBlackboard.GetValue("chunkMeshMemoryBudgetMB", 512);
+	float chunkCpuMeshKeepRange = g_gameConfigBlackboard.GetValue("chunkCpuMeshKeepRange", 48.f);
+	m_chunkMeshResidency = new ChunkMeshResidency(size_t(chunkMeshMemoryBudgetMB) * 1024 * 1024, chunkCpuMeshKeepRange);
 
 	//spawn player
-	m_player = new Entity(this, Vec3(8.f, 8.f, 90.f));
+	m_player = new Entity(this, Vec3(0.5f * CHUNK_SIZE_X, 0.5f * CHUNK_SIZE_Y, 0.7f * CHUNK_SIZE_Z));
 	m_playerWorldCamera = new GameCamera(this, m_player);
 	m_player->m_gameCamera = m_playerWorldCamera;
 	Player* m_playerController = new Player(this);
@@ -85,12 +120,33 @@ World::World(Game* game)
 
 World::~World()
 {
+	//saved while every neighbour is still around, so their borders can be kept with the light
 	for (auto iter = m_activeChunks.begin(); iter != m_activeChunks.end(); ++iter)
 	{
+		iter->second->SaveBlocksIfNeeded();
+		iter->second->SaveMeshCacheIfNeeded();
+	}
+
+	for (auto iter = m_activeChunks.begin(); iter != m_activeChunks.end(); ++iter)
+	{
+		ReleaseChunkHandle(iter->second->GetHandle());
 		delete iter->second;
 	}
 	m_activeChunks.clear();
 
+	for (int i = 0; i < (int)m_finishedMeshJobs.size(); i++)
+	{
+		delete m_finishedMeshJobs[i];
+	}
+	m_finishedMeshJobs.clear();
+
+	delete m_quadIndexBuffer;
+	m_quadIndexBuffer = nullptr;
+	delete m_digCrackOverlayVBO;
+	m_digCrackOverlayVBO = nullptr;
+	delete m_chunkMeshResidency;
+	m_chunkMeshResidency = nullptr;
+
 	delete m_gameCBO;
 	m_gameCBO = nullptr;
 
@@ -103,6 +159,7 @@ void World::Update(float deltaSeconds)
 	UpdateDayCycle(deltaSeconds);
 	HandleDebugInput();
 
+	RetrieveFinishedJobs();
 	InstantiateChunk();
 	bool chunkActivated = ActivateChunk();
 	if (!chunkActivated)
@@ -119,7 +176,9 @@ void World::Update(float deltaSeconds)
 	counter++;
 
 	PerformRaycast();
+	UpdateDigCrackOverlay();
 	UpdateChunks(deltaSeconds);
+	m_chunkMeshResidency->Update(m_activeChunks, Vec2(m_player->m_position.x, m_player->m_position.y));
 	UpdateEntities(deltaSeconds);
 	UpdateCameras(deltaSeconds);
 }
@@ -140,6 +199,7 @@ void World::Render() const
 		g_theRenderer->SetModelMatrix(Mat44());
 		g_theRenderer->BindShader(m_shader);
 		RenderChunks();
+		RenderDigCrackOverlay();
 		RenderEntities();
 		RenderRaycastImpact();
 
@@ -167,11 +227,48 @@ void World::AddToTotalNumberOfVerticesInChunks(int verts)
 	m_totalChunkMeshVertices += verts;
 }
 
+void World::ReserveQuadIndices(int numQuads)
+{
+	if (numQuads <= m_numQuadsInIndexBuffer)
+		return;
+
+	//grows in powers of two, so after the first few chunks it is never rebuilt again
+	int newNumQuads = std::max(m_numQuadsInIndexBuffer, 1024);
+	while (newNumQuads < numQuads)
+	{
+		newNumQuads *= 2;
+	}
+
+	std::vector<unsigned int> indices;
+	indices.reserve(size_t(newNumQuads) * 6);
+	for (int quad = 0; quad < newNumQuads; quad++)
+	{
+		unsigned int firstVertex = (unsigned int)quad * NUM_FACE_CORNERS;
+		indices.push_back(firstVertex + FACE_CORNER_TOP_LEFT);
+		indices.push_back(firstVertex + FACE_CORNER_BOTTOM_LEFT);
+		indices.push_back(firstVertex + FACE_CORNER_BOTTOM_RIGHT);
+		indices.push_back(firstVertex + FACE_CORNER_TOP_LEFT);
+		indices.push_back(firstVertex + FACE_CORNER_BOTTOM_RIGHT);
+		indices.push_back(firstVertex + FACE_CORNER_TOP_RIGHT);
+	}
+
+	delete m_quadIndexBuffer;
+	size_t size = sizeof(unsigned int) * indices.size();
+	m_quadIndexBuffer = g_theRenderer->CreateIndexBuffer(size);
+	g_theRenderer->CopyCPUToGPU(indices.data(), size, m_quadIndexBuffer);
+	m_numQuadsInIndexBuffer = newNumQuads;
+}
+
 void World::DigBlock()
 {
 	if (m_raycastResult.m_didImpact)
 	{
-		m_raycastResult.m_blockImpacted.m_chunkBlockBelongsTo->DigBlock(m_raycastResult.m_blockImpacted);
+		//the chunk hit by the cached raycast may have been deactivated since
+		Chunk* chunk = ResolveChunkHandle(m_raycastResult.m_chunkImpacted);
+		if (chunk)
+		{
+			chunk->DigBlock({ chunk, m_raycastResult.m_blockImpacted.m_blockIndex });
+		}
 	}
 }
 
@@ -193,21 +290,27 @@ void World::AddBlock()
 	}
 	else if (m_raycastResult.m_didImpact)
 	{
+		Chunk* chunk = ResolveChunkHandle(m_raycastResult.m_chunkImpacted);
+		if (chunk == nullptr)
+			return;
+
+		BlockIterator blockImpacted = { chunk, m_raycastResult.m_blockImpacted.m_blockIndex };
 		BlockIterator blockToAdd;
 		if (m_raycastResult.m_impactNormal.x > 0.f)
-			blockToAdd = m_raycastResult.m_blockImpacted.GetEastNeighbour();
+			blockToAdd = blockImpacted.GetEastNeighbour();
 		else if (m_raycastResult.m_impactNormal.x < 0.f)
-			blockToAdd = m_raycastResult.m_blockImpacted.GetWestNeighbour();
+			blockToAdd = blockImpacted.GetWestNeighbour();
 		else if (m_raycastResult.m_impactNormal.y > 0.f)
-			blockToAdd = m_raycastResult.m_blockImpacted.GetNorthNeighbour();
+			blockToAdd = blockImpacted.GetNorthNeighbour();
 		else if (m_raycastResult.m_impactNormal.y < 0.f)
-			blockToAdd = m_raycastResult.m_blockImpacted.GetSouthNeighbour();
+			blockToAdd = blockImpacted.GetSouthNeighbour();
 		else if (m_raycastResult.m_impactNormal.z > 0.f)
-			blockToAdd = m_raycastResult.m_blockImpacted.GetAboveNeighbour();
+			blockToAdd = blockImpacted.GetAboveNeighbour();
 		else if (m_raycastResult.m_impactNormal.z < 0.f)
-			blockToAdd = m_raycastResult.m_blockImpacted.GetBelowNeighbour();
+			blockToAdd = blockImpacted.GetBelowNeighbour();
 
-		blockToAdd.m_chunkBlockBelongsTo->AddBlock(blockToAdd);
+		if (blockToAdd.m_chunkBlockBelongsTo)
+			blockToAdd.m_chunkBlockBelongsTo->AddBlock(blockToAdd);
 	}
 }
 
@@ -243,6 +346,17 @@ void World::HandleDebugInput()
 		m_blockTypeToAdd = 8;
 	if (g_theInput->WasKeyJustPressed('9'))
 		m_blockTypeToAdd = 9;
+	if (g_theInput->WasKeyJustPressed('0'))
+	{
+		//cycles through the shaped blocks, starting with the first when something else is selected
+		int nextShapedBlock = 0;
+		for (int i = 0; i < NUM_SHAPED_BLOCK_NAMES; i++)
+		{
+			if (m_blockTypeToAdd == BlockDefintion::GetDefinitionIndexByName(SHAPED_BLOCK_NAMES[i]))
+				nextShapedBlock = (i + 1) % NUM_SHAPED_BLOCK_NAMES;
+		}
+		m_blockTypeToAdd = BlockDefintion::GetDefinitionIndexByName(SHAPED_BLOCK_NAMES[nextShapedBlock]);
+	}
 
 	if (g_theInput->WasKeyJustPressed(KEYCODE_F2))
 	{
@@ -266,12 +380,20 @@ void World::AddDebugVertsForChunk(std::vector<Vertex_PCU>& verts) const
 void World::AddDebugVertsForLighting(std::vector<Vertex_PCU>& verts) const
 {
 	constexpr float sideHalfLength = 0.05f;
-	for (auto iter = m_dirtyLightBlocks.begin(); iter != m_dirtyLightBlocks.end(); ++iter)
+	for (int i = 0; i < (int)m_chunksWithDirtyLighting.size(); i++)
 	{
-		Vec3 center = iter->GetWorldCenter();
-		Vec3 translateCenterVector = Vec3(sideHalfLength, sideHalfLength, sideHalfLength);
-		AABB3 bounds = AABB3(center - translateCenterVector, center + translateCenterVector);
-		AddVertsForAABB3D(verts, bounds, Rgba8::YELLOW);
+		Chunk* chunk = ResolveChunkHandle(m_chunksWithDirtyLighting[i]);
+		if (chunk == nullptr)
+			continue;
+
+		const std::deque<int>& dirtyLightBlocks = chunk->GetDirtyLightBlocks();
+		for (auto iter = dirtyLightBlocks.begin(); iter != dirtyLightBlocks.end(); ++iter)
+		{
+			Vec3 center = BlockIterator{ chunk, *iter }.GetWorldCenter();
+			Vec3 translateCenterVector = Vec3(sideHalfLength, sideHalfLength, sideHalfLength);
+			AABB3 bounds = AABB3(center - translateCenterVector, center + translateCenterVector);
+			AddVertsForAABB3D(verts, bounds, Rgba8::YELLOW);
+		}
 	}
 }
 
@@ -296,7 +418,7 @@ void World::InstantiateChunk()
 			if (GetDistanceSquared2D(cameraPosXY, chunkCenterPositon) < m_chunkActivationRange * m_chunkActivationRange)
 			{
 				std::map<IntVec2, Chunk*>::const_iterator iter = m_chunksQueuedForGeneration.find(chunkCoord);
-				if (iter == m_chunksQueuedForGeneration.end())
+				if (iter == m_chunksQueuedForGeneration.end() && m_chunksPendingSave.find(chunkCoord) == m_chunksPendingSave.end())
 				{
 					float sqDistance = GetDistanceSquared2D(cameraPosXY, chunkCenterPositon);
 					if (sqDistance < shortestSquaredDistance)
@@ -314,6 +436,7 @@ void World::InstantiateChunk()
 	if (instantiateChunk)
 	{
 		Chunk* newChunk = new Chunk(this, coordsOfChunkToActivate);
+		newChunk->SetHandle(AllocateChunkHandle(newChunk));
 		ChunkGenerationJob* job = new ChunkGenerationJob(newChunk);
 		g_theJobSystem->QueueJobs(job);
 		newChunk->m_status = ACTIVATING_QUEUED_GENERATE;
@@ -321,12 +444,113 @@ void World::InstantiateChunk()
 	}
 }
 
+ChunkHandle World::AllocateChunkHandle(Chunk* chunk)
+{
+	uint32_t slotIndex = 0;
+	if (!m_freeChunkSlots.empty())
+	{
+		slotIndex = m_freeChunkSlots.back();
+		m_freeChunkSlots.pop_back();
+	}
+	else
+	{
+		slotIndex = (uint32_t)m_chunkSlots.size();
+		m_chunkSlots.emplace_back();
+	}
+
+	ChunkSlot& slot = m_chunkSlots[slotIndex];
+	slot.m_chunk = chunk;
+
+	ChunkHandle handle;
+	handle.m_index = slotIndex;
+	handle.m_generation = slot.m_generation;
+	return handle;
+}
+
+void World::ReleaseChunkHandle(const ChunkHandle& handle)
+{
+	if (ResolveChunkHandle(handle) == nullptr)
+		return;
+
+	//bumping the generation invalidates every handle still pointing at this slot
+	ChunkSlot& slot = m_chunkSlots[handle.m_index];
+	slot.m_chunk = nullptr;
+	slot.m_generation++;
+	m_freeChunkSlots.push_back(handle.m_index);
+}
+
+Chunk* World::ResolveChunkHandle(const ChunkHandle& handle) const
+{
+	if (!handle.IsValid() || handle.m_index >= (uint32_t)m_chunkSlots.size())
+		return nullptr;
+
+	const ChunkSlot& slot = m_chunkSlots[handle.m_index];
+	if (slot.m_generation != handle.m_generation)
+		return nullptr;
+
+	return slot.m_chunk;
+}
+
+void World::QueueSaveJob(ChunkSaveJob* saveJob)
+{
+	//only the blocks have to be on disk before the chunk can be loaded again, a mesh cache written late only misses
+	if (saveJob->m_snapshot)
+		m_chunksPendingSave.insert(saveJob->m_chunkCoords);
+	m_chunkMeshResidency->AddMeshCacheBytesPendingSave(saveJob->m_meshCacheBytes);
+	g_theJobSystem->QueueJobs(saveJob);
+}
+
+void World::RetrieveFinishedJobs()
+{
+	//the job system hands back finished jobs of every type, sort them out here
+	Job* finishedJob = g_theJobSystem->RetrieveFinishedJob();
+	while (finishedJob)
+	{
+		ChunkGenerationJob* generationJob = dynamic_cast<ChunkGenerationJob*>(finishedJob);
+		ChunkSaveJob* saveJob = dynamic_cast<ChunkSaveJob*>(finishedJob);
+		ChunkMeshJob* meshJob = dynamic_cast<ChunkMeshJob*>(finishedJob);
+		if (generationJob)
+		{
+			//chunks are activated one per frame in ActivateChunk
+			m_finishedGenerationJobs.push_back(generationJob);
+		}
+		else if (saveJob)
+		{
+			g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("Chunk [%d, %d] took %f time to save to disk", saveJob->m_chunkCoords.x, saveJob->m_chunkCoords.y, saveJob->m_saveTimeMs));
+			if (saveJob->m_snapshot)
+				m_chunksPendingSave.erase(saveJob->m_chunkCoords);
+			m_chunkMeshResidency->RemoveMeshCacheBytesPendingSave(saveJob->m_meshCacheBytes);
+			delete saveJob;
+		}
+		else if (meshJob)
+		{
+			//uploaded in UpdateChunkMeshes as the frame's mesh budget allows, the job's slot is free for a new one already
+			m_numMeshJobsInFlight--;
+			m_finishedMeshJobs.push_back(meshJob);
+		}
+		else
+		{
+			delete finishedJob;
+		}
+		finishedJob = g_theJobSystem->RetrieveFinishedJob();
+	}
+}
+
 bool World::ActivateChunk()
 {
-	ChunkGenerationJob* finishedGenerationJob = dynamic_cast<ChunkGenerationJob*>(g_theJobSystem->RetrieveFinishedJob());
-	if (finishedGenerationJob)
+	if (!m_finishedGenerationJobs.empty())
 	{
-		Chunk* chunk = finishedGenerationJob->m_chunk;
+		ChunkGenerationJob* finishedGenerationJob = m_finishedGenerationJobs.front();
+		m_finishedGenerationJobs.pop_front();
+		Chunk* chunk = ResolveChunkHandle(finishedGenerationJob->m_chunkHandle);
+		if (chunk == nullptr)
+		{
+			//the chunk was released while it was generating, the job is the last owner of it
+			delete finishedGenerationJob->m_chunk;
+			delete finishedGenerationJob;
+			return false;
+		}
+
 		IntVec2 chunkCoords = chunk->GetChunkCoordinates();
 		m_activeChunks[chunkCoords] = chunk;
 
@@ -358,9 +582,18 @@ bool World::ActivateChunk()
 			iter->second->m_eastNeighbour = chunk;
 		}
 
-		chunk->InitializeLighting();
+		chunk->MergeBorderLighting();
 		chunk->m_status = ACTIVE;
 
+		//neighbours that were meshed without this chunk rebuild the slices that gain faces on the shared side
+		chunk->QueueMeshRebuildIfDirty();
+		Chunk* neighbours[4] = { chunk->m_northNeighbour, chunk->m_eastNeighbour, chunk->m_southNeighbour, chunk->m_westNeighbour };
+		for (int i = 0; i < 4; i++)
+		{
+			if (neighbours[i])
+				neighbours[i]->OnNeighbourActivated(*chunk);
+		}
+
 		//delete the finished job
 		delete finishedGenerationJob;
 
@@ -391,6 +624,13 @@ void World::DeactivateChunk()
 
 	if (chunkToDeactivate)
 	{
+		//hand the block data and mesh cache to a save job so the disk write does not stall the frame, while the neighbours whose borders go with the light are still linked
+		ChunkSaveJob* saveJob = chunkToDeactivate->CreateSaveJob();
+		if (saveJob)
+		{
+			QueueSaveJob(saveJob);
+		}
+
 		if (chunkToDeactivate->m_northNeighbour)
 		{
 			chunkToDeactivate->m_northNeighbour->m_southNeighbour = nullptr;
@@ -424,46 +664,102 @@ void World::DeactivateChunk()
 		}
 
 		//remove from 
+		ReleaseChunkHandle(chunkToDeactivate->GetHandle());
 		delete chunkToDeactivate;
 	}
 }
 
 void World::UpdateChunks(float deltaSeconds)
 {
-	constexpr int numchunksToRebuild = 2;
-	std::vector<Chunk*> chunksToRebuild;
-	chunksToRebuild.reserve(m_activeChunks.size());
 	for (auto iter = m_activeChunks.begin(); iter != m_activeChunks.end(); ++iter)
 	{
 		iter->second->Update(deltaSeconds);
-		if (iter->second->ShouldRebuildMesh())
-			chunksToRebuild.push_back(iter->second);
 	}
 
-	//get closest 2 chunks and then rebuild them
+	UpdateChunkMeshes();
+}
+
+void World::QueueChunkForLighting(const Chunk& chunk)
+{
+	m_chunksWithDirtyLighting.push_back(chunk.GetHandle());
+}
+
+void World::QueueChunkForMeshRebuild(const Chunk& chunk)
+{
+	ChunkMeshQueueEntry entry;
+	entry.m_chunkHandle = chunk.GetHandle();
+	entry.m_distanceSquared = GetDistanceSquared2D(m_chunkMeshQueueCameraXY, Chunk::GetChunkCenterXYForGlobalChunkCoords(chunk.GetChunkCoordinates()));
+	m_chunkMeshQueue.push_back(entry);
+	std::push_heap(m_chunkMeshQueue.begin(), m_chunkMeshQueue.end());
+}
+
+void World::UpdateChunkMeshes()
+{
+	//the queue keeps the distances it was built with until the camera has moved a chunk away from where they were computed
 	Vec2 camXY = Vec2(m_player->m_position.x, m_player->m_position.y);
-	for (int i = 0; i < numchunksToRebuild; i++)
+	if (GetDistanceSquared2D(camXY, m_chunkMeshQueueCameraXY) > float(CHUNK_SIZE_X * CHUNK_SIZE_X))
 	{
-		float closestDistance = FLT_MAX;
-		Chunk* closestChunk = nullptr;
-		for (int j = 0; j < chunksToRebuild.size(); j++)
-		{
-			float distance = GetDistanceSquared2D(Chunk::GetChunkCenterXYForGlobalChunkCoords(chunksToRebuild[j]->GetChunkCoordinates()), camXY);
-			if (distance < closestDistance)
-			{
-				closestChunk = chunksToRebuild[j];
-				closestDistance = distance;
-			}
-		}
+		ReprioritizeChunkMeshQueue(camXY);
+	}
 
-		if (closestChunk)
+	//finished meshes go first, they are what puts the rebuilt chunks on screen
+	//at least one upload and one new job happen every frame so a slow frame cannot stall the queue completely
+	double budgetEndTime = GetCurrentTimeSeconds() + double(m_chunkMeshBudgetMs) * 0.001;
+	int numMeshesUploaded = 0;
+	while (!m_finishedMeshJobs.empty() && (numMeshesUploaded == 0 || GetCurrentTimeSeconds() < budgetEndTime))
+	{
+		//the chunk may have been deactivated while it was being meshed
+		ChunkMeshJob* meshJob = m_finishedMeshJobs.front();
+		m_finishedMeshJobs.pop_front();
+		Chunk* chunk = ResolveChunkHandle(meshJob->m_chunkHandle);
+		if (chunk)
 		{
-			closestChunk->GenerateGeometry();
-			closestChunk = nullptr;
-			closestDistance = FLT_MAX;
+			chunk->OnMeshJobFinished(*meshJob);
+			numMeshesUploaded++;
 		}
+		delete meshJob;
 	}
 
+	int numJobsQueued = 0;
+	while (!m_chunkMeshQueue.empty() && m_numMeshJobsInFlight < m_maxMeshJobsInFlight && (numJobsQueued == 0 || GetCurrentTimeSeconds() < budgetEndTime))
+	{
+		std::pop_heap(m_chunkMeshQueue.begin(), m_chunkMeshQueue.end());
+		ChunkMeshQueueEntry entry = m_chunkMeshQueue.back();
+		m_chunkMeshQueue.pop_back();
+
+		Chunk* chunk = ResolveChunkHandle(entry.m_chunkHandle);
+		if (chunk == nullptr)
+			continue;
+
+		chunk->OnRemovedFromMeshRebuildQueue();
+		if (!chunk->ShouldRebuildMesh())
+			continue;
+
+		g_theJobSystem->QueueJobs(chunk->CreateMeshJob());
+		m_numMeshJobsInFlight++;
+		numJobsQueued++;
+	}
+}
+
+void World::ReprioritizeChunkMeshQueue(const Vec2& cameraXY)
+{
+	m_chunkMeshQueueCameraXY = cameraXY;
+
+	//entries of chunks that are gone are dropped here instead of waiting to reach the top
+	int numEntriesKept = 0;
+	for (int i = 0; i < (int)m_chunkMeshQueue.size(); i++)
+	{
+		Chunk* chunk = ResolveChunkHandle(m_chunkMeshQueue[i].m_chunkHandle);
+		if (chunk == nullptr)
+			continue;
+
+		ChunkMeshQueueEntry& entry = m_chunkMeshQueue[numEntriesKept];
+		entry.m_chunkHandle = m_chunkMeshQueue[i].m_chunkHandle;
+		entry.m_distanceSquared = GetDistanceSquared2D(cameraXY, Chunk::GetChunkCenterXYForGlobalChunkCoords(chunk->GetChunkCoordinates()));
+		numEntriesKept++;
+	}
+	m_chunkMeshQueue.resize(numEntriesKept);
+	std::make_heap(m_chunkMeshQueue.begin(), m_chunkMeshQueue.end());
 }
 
 void World::UpdateEntities(float deltaSeconds)
@@ -489,10 +785,22 @@ void World::RenderChunks() const
 		chunkList.push_back(iter->second);
 	}
 
+	//opaque meshes go near to far so the depth test throws away hidden pixels early
+	//translucent meshes go after all of them and far to near, each chunk blending over the ones behind it
 	std::sort(chunkList.begin(), chunkList.end(), ChunkSort(camPos));
+	for (auto iter = chunkList.begin(); iter != chunkList.end(); ++iter)
+	{
+		(*iter)->Render(CHUNK_MESH_PASS_OPAQUE);
+	}
 	for (auto iter = chunkList.rbegin(); iter != chunkList.rend(); ++iter)
 	{
-		(*iter)->Render();
+		(*iter)->Render(CHUNK_MESH_PASS_TRANSLUCENT);
+	}
+
+	//chunks drawing packed vertices set their own model matrix
+	if (m_usePackedChunkVertices)
+	{
+		g_theRenderer->SetModelMatrix(Mat44());
 	}
 }
 
@@ -528,6 +836,74 @@ void World::RenderRaycastImpact() const
 	}
 }
 
+void World::UpdateDigCrackOverlay()
+{
+	m_numDigCrackOverlayQuads = 0;
+	if (!m_raycastResult.m_didImpact)
+		return;
+
+	Chunk* chunk = ResolveChunkHandle(m_raycastResult.m_chunkImpacted);
+	if (chunk == nullptr)
+		return;
+
+	int blockIndex = m_raycastResult.m_blockImpacted.m_blockIndex;
+	uint8_t digState = chunk->GetBlockDigState(blockIndex);
+	if (digState == 0)
+		return;
+
+	//rebuilt every frame so the crack follows the light of the blocks around it
+	BlockIterator blockIter = { chunk, blockIndex };
+	BlockIterator neighbours[NUM_BLOCK_FACES];
+	neighbours[BLOCK_FACE_BOTTOM] = blockIter.GetBelowNeighbour();
+	neighbours[BLOCK_FACE_TOP] = blockIter.GetAboveNeighbour();
+	neighbours[BLOCK_FACE_WEST] = blockIter.GetWestNeighbour();
+	neighbours[BLOCK_FACE_SOUTH] = blockIter.GetSouthNeighbour();
+	neighbours[BLOCK_FACE_EAST] = blockIter.GetEastNeighbour();
+	neighbours[BLOCK_FACE_NORTH] = blockIter.GetNorthNeighbour();
+	const Block* frontBlocks[NUM_BLOCK_FACES] = {};
+	for (int face = 0; face < NUM_BLOCK_FACES; face++)
+	{
+		if (neighbours[face].m_chunkBlockBelongsTo)
+			frontBlocks[face] = neighbours[face].GetBlock();
+	}
+
+	std::vector<ChunkVertex> crackVerts;
+	ChunkMesher::AddVertsForDigCrack(crackVerts, chunk->GetLocalCoordsFromBlockIndex(blockIndex), frontBlocks, digState);
+	if (crackVerts.empty())
+		return;
+
+	size_t size = sizeof(ChunkVertex) * crackVerts.size();
+	if (m_digCrackOverlayVBO && size + CHUNK_VERTEX_BUFFER_PADDING > m_digCrackOverlayVBOSize)
+	{
+		delete m_digCrackOverlayVBO;
+		m_digCrackOverlayVBO = nullptr;
+	}
+	if (!m_digCrackOverlayVBO)
+	{
+		//room for a crack on every face of the block, so it is made once
+		m_digCrackOverlayVBOSize = sizeof(ChunkVertex) * NUM_BLOCK_FACES * NUM_FACE_CORNERS + CHUNK_VERTEX_BUFFER_PADDING;
+		m_digCrackOverlayVBO = g_theRenderer->CreateVertexBuffer(m_digCrackOverlayVBOSize, sizeof(ChunkVertex));
+	}
+	g_theRenderer->CopyCPUToGPU(crackVerts.data(), size, m_digCrackOverlayVBO);
+	m_numDigCrackOverlayQuads = (int)crackVerts.size() / NUM_FACE_CORNERS;
+	m_digCrackOverlayChunkMins = chunk->GetChunkWorldBounds().m_mins;
+	ReserveQuadIndices(m_numDigCrackOverlayQuads);
+}
+
+void World::RenderDigCrackOverlay() const
+{
+	if (m_numDigCrackOverlayQuads == 0)
+		return;
+
+	g_theRenderer->BindShader(m_digCrackOverlayShader);
+	g_theRenderer->BindTexture(BlockDefintion::s_blockSpriteTexture);
+	g_theRenderer->SetModelMatrix(Mat44::CreateTranslation3D(m_digCrackOverlayChunkMins));
+	g_theRenderer->BindVertexBuffer(m_digCrackOverlayVBO);
+	g_theRenderer->BindIndexBuffer(m_quadIndexBuffer);
+	g_theRenderer->DrawIndexed(m_numDigCrackOverlayQuads * 6);
+	g_theRenderer->SetModelMatrix(Mat44());
+}
+
 void World::UpdateDayCycle(float deltaSeconds)
 {
 	m_worldTime += (deltaSeconds * m_worldTimeScale * m_currentWorldTimeScaleAccelerationFactor) / (60.f * 60.f * 24.f);
@@ -577,248 +953,192 @@ void World::UpdateDayCycle(float deltaSeconds)
 
 void World::ProcessDirtyLighting()
 {
-	//for (auto iter = m_dirtyLightBlocks.begin(); iter != m_dirtyLightBlocks.end(); ++iter)
-	while(!m_dirtyLightBlocks.empty())
-	{
-		BlockIterator front = m_dirtyLightBlocks.front();
-		m_dirtyLightBlocks.pop_front();
-		Block* block = front.GetBlock();
-		block->SetIsBlockLightDirty(false);
-		//to-do: compute blocks indoor lighting influences
-		uint8_t currentIndoorLightInfluence = block->GetIndoorLightInfluence();
-		uint8_t computedIndoorLightInfluence = ComputeIndoorLightInfluence(front);
-		uint8_t currentOutdoorLightInfluence = block->GetOutdoorLightInfluence();
-		uint8_t computedOutdoorLightInfluence = ComputeOutdoorLightInfluence(front);
-		if ((currentOutdoorLightInfluence != computedOutdoorLightInfluence) || (currentIndoorLightInfluence != computedIndoorLightInfluence))
-		{
-			block->SetOutdoorLightInfluence(computedOutdoorLightInfluence);
-			block->SetIndoorLightInfluence(computedIndoorLightInfluence);
-			front.m_chunkBlockBelongsTo->SetChunkToDirty();
-			MarkNeighbouringChunksAndBlocksAsDirty(front);
-		}
-	}
-}
+	if (m_chunksWithDirtyLighting.empty())
+		return;
 
-uint8_t World::ComputeIndoorLightInfluence(const BlockIterator& blockIter) const
-{
-	uint8_t maxComputedLightInfluence = 0;
-	uint8_t computedLightInfluence = 0;
-	Block& block = *blockIter.GetBlock();
-	if (BlockDefintion::DoesBlockTypeEmitLight(block.m_typeIndex))
-	{
-		computedLightInfluence = BlockDefintion::s_definitions[block.m_typeIndex].m_indoorLightInfluence;
-		if (computedLightInfluence > maxComputedLightInfluence)
-			maxComputedLightInfluence = computedLightInfluence;
-	}
-	if (!BlockDefintion::IsBlockTypeOpaque(block.m_typeIndex))
+	//chunks queued while this frame's work runs go to the member list and are picked up next frame
+	std::vector<ChunkHandle> queuedChunks;
+	queuedChunks.swap(m_chunksWithDirtyLighting);
+	std::vector<Chunk*> chunks;
+	chunks.reserve(queuedChunks.size());
+	for (int i = 0; i < (int)queuedChunks.size(); i++)
 	{
-		computedLightInfluence = GetHighestIndoorLightInfluenceAmongNeighbours(blockIter);
-		if (computedLightInfluence > 0)
-			computedLightInfluence--;
-		if (computedLightInfluence > maxComputedLightInfluence)
-			maxComputedLightInfluence = computedLightInfluence;
+		Chunk* chunk = ResolveChunkHandle(queuedChunks[i]);
+		if (chunk)
+			chunks.push_back(chunk);
 	}
 
-	return maxComputedLightInfluence;
-}
-
-uint8_t World::ComputeOutdoorLightInfluence(const BlockIterator& blockIter) const
-{
-	uint8_t maxComputedLightInfluence = 0;
-	uint8_t computedLightInfluence = 0;
-	Block& block = *blockIter.GetBlock();
-	if (block.IsBlockSky())
+	//the closest chunks settle first, what is left when the budget runs out carries over to the next frame
+	//darkening runs before brightening, so light is not spread from blocks that are about to go dark
+	std::sort(chunks.begin(), chunks.end(), ChunkSort(Vec2(m_player->m_position.x, m_player->m_position.y)));
+	double budgetEndTime = GetCurrentTimeSeconds() + double(m_lightingBudgetMs) * 0.001;
+	int numUpdatesProcessed = 0;
+	bool isBudgetUsed = false;
+	for (int pass = 0; pass < 2 && !isBudgetUsed; pass++)
 	{
-		computedLightInfluence = 15;
-		if (computedLightInfluence > maxComputedLightInfluence)
-			maxComputedLightInfluence = computedLightInfluence;
+		bool includeIncreases = pass == 1;
+		for (int i = 0; i < (int)chunks.size() && !isBudgetUsed; i++)
+		{
+			while (ProcessNextLightUpdate(*chunks[i], includeIncreases))
+			{
+				//reading the clock for every update would cost more than most updates take
+				numUpdatesProcessed++;
+				if ((numUpdatesProcessed & 63) == 0 && GetCurrentTimeSeconds() >= budgetEndTime)
+				{
+					isBudgetUsed = true;
+					break;
+				}
+			}
+		}
 	}
-	if (!BlockDefintion::IsBlockTypeOpaque(block.m_typeIndex))
+
+	for (int i = 0; i < (int)chunks.size(); i++)
 	{
-		computedLightInfluence = GetHighestOutdoorLightInfluenceAmongNeighbours(blockIter);
-		if (computedLightInfluence > 0)
-			computedLightInfluence--;
-		if (computedLightInfluence > maxComputedLightInfluence)
-			maxComputedLightInfluence = computedLightInfluence;
+		if (chunks[i]->IsLightingSettled())
+			chunks[i]->OnLightingSettled();
+		else
+			m_chunksWithDirtyLighting.push_back(chunks[i]->GetHandle());
 	}
-
-	return maxComputedLightInfluence;
 }
 
-uint8_t World::GetHighestOutdoorLightInfluenceAmongNeighbours(const BlockIterator& blockIter) const
+bool World::ProcessNextLightUpdate(Chunk& chunk, bool includeIncreases)
 {
-	uint8_t maxOutdoorLightInfluence = 0;
-	uint8_t outdoorLightInfluence = 0;
-	BlockIterator neighbour = blockIter.GetNorthNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
-	{
-		outdoorLightInfluence = neighbour.GetBlock()->GetOutdoorLightInfluence();
-		if (outdoorLightInfluence > maxOutdoorLightInfluence)
-			maxOutdoorLightInfluence = outdoorLightInfluence;
-	}
-
-	neighbour = blockIter.GetEastNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
-	{
-		outdoorLightInfluence = neighbour.GetBlock()->GetOutdoorLightInfluence();
-		if (outdoorLightInfluence > maxOutdoorLightInfluence)
-			maxOutdoorLightInfluence = outdoorLightInfluence;
-	}
-
-	neighbour = blockIter.GetSouthNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
-	{
-		outdoorLightInfluence = neighbour.GetBlock()->GetOutdoorLightInfluence();
-		if (outdoorLightInfluence > maxOutdoorLightInfluence)
-			maxOutdoorLightInfluence = outdoorLightInfluence;
-	}
-
-	neighbour = blockIter.GetWestNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
-	{
-		outdoorLightInfluence = neighbour.GetBlock()->GetOutdoorLightInfluence();
-		if (outdoorLightInfluence > maxOutdoorLightInfluence)
-			maxOutdoorLightInfluence = outdoorLightInfluence;
-	}
-
-	neighbour = blockIter.GetNorthNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
+	int blockIndex = 0;
+	if (chunk.PopDirtyLightBlock(blockIndex))
 	{
-		outdoorLightInfluence = neighbour.GetBlock()->GetOutdoorLightInfluence();
-		if (outdoorLightInfluence > maxOutdoorLightInfluence)
-			maxOutdoorLightInfluence = outdoorLightInfluence;
+		ProcessDirtyLightBlock({ &chunk, blockIndex });
+		return true;
 	}
 
-	neighbour = blockIter.GetAboveNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
+	LightQueueEntry entry;
+	if (chunk.PopLightDecrease(entry))
 	{
-		outdoorLightInfluence = neighbour.GetBlock()->GetOutdoorLightInfluence();
-		if (outdoorLightInfluence > maxOutdoorLightInfluence)
-			maxOutdoorLightInfluence = outdoorLightInfluence;
+		ProcessLightDecrease({ &chunk, entry.m_blockIndex }, entry.m_channel, entry.m_level);
+		return true;
 	}
 
-	neighbour = blockIter.GetBelowNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
+	if (includeIncreases && chunk.PopLightIncrease(entry))
 	{
-		outdoorLightInfluence = neighbour.GetBlock()->GetOutdoorLightInfluence();
-		if (outdoorLightInfluence > maxOutdoorLightInfluence)
-			maxOutdoorLightInfluence = outdoorLightInfluence;
+		ProcessLightIncrease({ &chunk, entry.m_blockIndex }, entry.m_channel, entry.m_level);
+		return true;
 	}
 
-	return maxOutdoorLightInfluence;
+	return false;
 }
 
-uint8_t World::GetHighestIndoorLightInfluenceAmongNeighbours(const BlockIterator& blockIter) const
+void World::ProcessDirtyLightBlock(const BlockIterator& blockIter)
 {
-	uint8_t maxIndoorLightInfluence = 0;
-	uint8_t indoorLightInfluence = 0;
-	BlockIterator neighbour = blockIter.GetNorthNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
-	{
-		indoorLightInfluence = neighbour.GetBlock()->GetIndoorLightInfluence();
-		if (indoorLightInfluence > maxIndoorLightInfluence)
-			maxIndoorLightInfluence = indoorLightInfluence;
-	}
-
-	neighbour = blockIter.GetEastNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
+	//the block's sources or opacity changed, check each channel against its neighbours once and start a wave from it if it is off
+	const Block* block = blockIter.GetBlock();
+	BlockIterator neighbours[6];
+	int numNeighbours = blockIter.GetNeighbours(neighbours);
+	bool isOpaque = BlockDefintion::IsBlockTypeOpaque(block->m_typeIndex);
+	for (int channelIndex = 0; channelIndex < NUM_LIGHT_CHANNELS; channelIndex++)
 	{
-		indoorLightInfluence = neighbour.GetBlock()->GetIndoorLightInfluence();
-		if (indoorLightInfluence > maxIndoorLightInfluence)
-			maxIndoorLightInfluence = indoorLightInfluence;
-	}
+		LightChannel channel = LightChannel(channelIndex);
+		uint8_t sourceLevel = blockIter.GetLightSourceLevel(channel);
+		uint8_t expectedLevel = sourceLevel;
+		for (int i = 0; i < numNeighbours && !isOpaque; i++)
+		{
+			uint8_t neighbourLevel = neighbours[i].GetBlock()->GetLightInfluence(channel);
+			if (neighbourLevel > expectedLevel + 1)
+				expectedLevel = neighbourLevel - 1;
+		}
 
-	neighbour = blockIter.GetSouthNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
-	{
-		indoorLightInfluence = neighbour.GetBlock()->GetIndoorLightInfluence();
-		if (indoorLightInfluence > maxIndoorLightInfluence)
-			maxIndoorLightInfluence = indoorLightInfluence;
+		uint8_t currentLevel = block->GetLightInfluence(channel);
+		if (expectedLevel > currentLevel)
+		{
+			blockIter.GetBlockForWrite()->SetLightInfluence(channel, expectedLevel);
+			OnBlockLightChanged(blockIter);
+			blockIter.m_chunkBlockBelongsTo->QueueLightIncrease(blockIter.m_blockIndex, channel, expectedLevel);
+		}
+		else if (expectedLevel < currentLevel)
+		{
+			//the light it had may have come back to it through its neighbours, so it goes dark and everything it lit is redone
+			DarkenBlockLight(blockIter, channel);
+		}
 	}
+}
 
-	neighbour = blockIter.GetWestNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
+void World::ProcessLightDecrease(const BlockIterator& blockIter, LightChannel channel, uint8_t previousLevel)
+{
+	BlockIterator neighbours[6];
+	int numNeighbours = blockIter.GetNeighbours(neighbours);
+	for (int i = 0; i < numNeighbours; i++)
 	{
-		indoorLightInfluence = neighbour.GetBlock()->GetIndoorLightInfluence();
-		if (indoorLightInfluence > maxIndoorLightInfluence)
-			maxIndoorLightInfluence = indoorLightInfluence;
+		const Block* neighbour = neighbours[i].GetBlock();
+		uint8_t neighbourLevel = neighbour->GetLightInfluence(channel);
+		if (neighbourLevel == 0)
+			continue;
+
+		//dimmer neighbours may have been lit by this block and go dark as well, the others (and sources) spread their light back in
+		uint8_t sourceLevel = neighbours[i].GetLightSourceLevel(channel);
+		if (neighbourLevel < previousLevel && neighbourLevel > sourceLevel)
+		{
+			DarkenBlockLight(neighbours[i], channel);
+		}
+		else
+		{
+			neighbours[i].m_chunkBlockBelongsTo->QueueLightIncrease(neighbours[i].m_blockIndex, channel, neighbourLevel);
+		}
 	}
+}
 
-	neighbour = blockIter.GetNorthNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
-	{
-		indoorLightInfluence = neighbour.GetBlock()->GetIndoorLightInfluence();
-		if (indoorLightInfluence > maxIndoorLightInfluence)
-			maxIndoorLightInfluence = indoorLightInfluence;
-	}
+void World::ProcessLightIncrease(const BlockIterator& blockIter, LightChannel channel, uint8_t level)
+{
+	//the block was changed again after it was queued, whatever changed it queued it again with its new level
+	if (blockIter.GetBlock()->GetLightInfluence(channel) != level || level <= 1)
+		return;
 
-	neighbour = blockIter.GetAboveNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
+	BlockIterator neighbours[6];
+	int numNeighbours = blockIter.GetNeighbours(neighbours);
+	for (int i = 0; i < numNeighbours; i++)
 	{
-		indoorLightInfluence = neighbour.GetBlock()->GetIndoorLightInfluence();
-		if (indoorLightInfluence > maxIndoorLightInfluence)
-			maxIndoorLightInfluence = indoorLightInfluence;
-	}
+		const Block* neighbour = neighbours[i].GetBlock();
+		if (BlockDefintion::IsBlockTypeOpaque(neighbour->m_typeIndex) || neighbour->GetLightInfluence(channel) + 1 >= level)
+			continue;
 
-	neighbour = blockIter.GetBelowNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo)
-	{
-		indoorLightInfluence = neighbour.GetBlock()->GetIndoorLightInfluence();
-		if (indoorLightInfluence > maxIndoorLightInfluence)
-			maxIndoorLightInfluence = indoorLightInfluence;
+		neighbours[i].GetBlockForWrite()->SetLightInfluence(channel, level - 1);
+		OnBlockLightChanged(neighbours[i]);
+		neighbours[i].m_chunkBlockBelongsTo->QueueLightIncrease(neighbours[i].m_blockIndex, channel, uint8_t(level - 1));
 	}
-
-	return maxIndoorLightInfluence;
 }
 
-void World::MarkNeighbouringChunksAndBlocksAsDirty(const BlockIterator& blockIter)
+void World::DarkenBlockLightToSources(const BlockIterator& blockIter)
 {
-	BlockIterator neighbour = blockIter.GetNorthNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo != nullptr)
-	{
-		neighbour.m_chunkBlockBelongsTo->SetChunkToDirty();
-		if (!BlockDefintion::IsBlockTypeOpaque(neighbour.GetBlock()->m_typeIndex))
-			MarkLightingDirty(neighbour);
-	}
-
-	neighbour = blockIter.GetEastNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo != nullptr)
-	{
-		neighbour.m_chunkBlockBelongsTo->SetChunkToDirty();
-		if (!BlockDefintion::IsBlockTypeOpaque(neighbour.GetBlock()->m_typeIndex))
-			MarkLightingDirty(neighbour);
-	}
-
-	neighbour = blockIter.GetSouthNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo != nullptr)
+	const Block* block = blockIter.GetBlock();
+	for (int channelIndex = 0; channelIndex < NUM_LIGHT_CHANNELS; channelIndex++)
 	{
-		neighbour.m_chunkBlockBelongsTo->SetChunkToDirty();
-		if (!BlockDefintion::IsBlockTypeOpaque(neighbour.GetBlock()->m_typeIndex))
-			MarkLightingDirty(neighbour);
+		LightChannel channel = LightChannel(channelIndex);
+		if (block->GetLightInfluence(channel) > blockIter.GetLightSourceLevel(channel))
+			DarkenBlockLight(blockIter, channel);
 	}
+}
 
-	neighbour = blockIter.GetWestNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo != nullptr)
-	{
-		neighbour.m_chunkBlockBelongsTo->SetChunkToDirty();
-		if (!BlockDefintion::IsBlockTypeOpaque(neighbour.GetBlock()->m_typeIndex))
-			MarkLightingDirty(neighbour);
-	}
+void World::DarkenBlockLight(const BlockIterator& blockIter, LightChannel channel)
+{
+	Block* block = blockIter.GetBlockForWrite();
+	uint8_t previousLevel = block->GetLightInfluence(channel);
+	uint8_t sourceLevel = blockIter.GetLightSourceLevel(channel);
+	block->SetLightInfluence(channel, sourceLevel);
+	OnBlockLightChanged(blockIter);
+	blockIter.m_chunkBlockBelongsTo->QueueLightDecrease(blockIter.m_blockIndex, channel, previousLevel);
+	if (sourceLevel > 0)
+		blockIter.m_chunkBlockBelongsTo->QueueLightIncrease(blockIter.m_blockIndex, channel, sourceLevel);
+}
 
-	neighbour = blockIter.GetAboveNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo != nullptr)
-	{
-		neighbour.m_chunkBlockBelongsTo->SetChunkToDirty();
-		if (!BlockDefintion::IsBlockTypeOpaque(neighbour.GetBlock()->m_typeIndex))
-			MarkLightingDirty(neighbour);
-	}
+void World::OnBlockLightChanged(const BlockIterator& blockIter)
+{
+	Chunk* chunk = blockIter.m_chunkBlockBelongsTo;
+	chunk->MarkBlockDataChanged();
+	chunk->SetMeshDirtyForLightChange(blockIter.m_blockIndex);
 
-	neighbour = blockIter.GetBelowNeighbour();
-	if (neighbour.m_chunkBlockBelongsTo != nullptr)
+	//faces of the neighbouring chunks' border blocks are lit by this block too
+	BlockIterator horizontalNeighbours[4] = { blockIter.GetEastNeighbour(), blockIter.GetWestNeighbour(), blockIter.GetNorthNeighbour(), blockIter.GetSouthNeighbour() };
+	for (int i = 0; i < 4; i++)
 	{
-		neighbour.m_chunkBlockBelongsTo->SetChunkToDirty();
-		if (!BlockDefintion::IsBlockTypeOpaque(neighbour.GetBlock()->m_typeIndex))
-			MarkLightingDirty(neighbour);
+		if (horizontalNeighbours[i].m_chunkBlockBelongsTo && horizontalNeighbours[i].m_chunkBlockBelongsTo != chunk)
+			horizontalNeighbours[i].m_chunkBlockBelongsTo->SetMeshDirtyForLightChange(horizontalNeighbours[i].m_blockIndex);
 	}
 }
 
@@ -834,6 +1154,19 @@ void World::CopyDataToCBOAndBindIt() const
 	gameConstants.fogEndDistance = m_fogEndDistance;
 	gameConstants.fogMaxAlpha = m_fogMaxAlpha;
 	gameConstants.worldTime = m_worldTime;
+	//every block texture is one sprite of the same sheet, so any definition gives the tile size
+	Vec2 blockTileUVSize = BlockDefintion::s_definitions[0].m_topUVs.m_maxs - BlockDefintion::s_definitions[0].m_topUVs.m_mins;
+	gameConstants.blockTileUVSize[0] = blockTileUVSize.x;
+	gameConstants.blockTileUVSize[1] = blockTileUVSize.y;
+	//packed vertices only carry the sprite index, the sheet's own uvs say where sprite 0 is and how far the next column and row are from it
+	const AABB2& firstSpriteUVs = BlockDefintion::GetSpriteUVs(0);
+	int spriteSheetWidth = BlockDefintion::s_spriteSheetDimensions.x;
+	gameConstants.spriteUVOrigin[0] = firstSpriteUVs.m_mins.x;
+	gameConstants.spriteUVOrigin[1] = firstSpriteUVs.m_mins.y;
+	gameConstants.spriteUVStep[0] = BlockDefintion::GetSpriteUVs(1).m_mins.x - firstSpriteUVs.m_mins.x;
+	gameConstants.spriteUVStep[1] = BlockDefintion::GetSpriteUVs(spriteSheetWidth).m_mins.y - firstSpriteUVs.m_mins.y;
+	gameConstants.spriteSheetWidth = (float)spriteSheetWidth;
+	gameConstants.padding = 0.f;
 
 	g_theRenderer->CopyCPUToGPU(&gameConstants, sizeof(GameConstants), m_gameCBO);
 	g_theRenderer->BindConstantBuffer(gameConstantsSlotNumber, m_gameCBO);
@@ -848,6 +1181,10 @@ void World::PerformRaycast()
 	}
 
 	m_raycastResult = RaycastVsWorld(m_cameraStart, m_cameraForward, raycastDistance);
+	if (m_raycastResult.m_didImpact)
+	{
+		m_raycastResult.m_chunkImpacted = m_raycastResult.m_blockImpacted.m_chunkBlockBelongsTo->GetHandle();
+	}
 }
 
 GameRaycastResult3D World::RaycastVsWorld(const Vec3& start, const Vec3& direction, float distance)
@@ -968,33 +1305,7 @@ GameRaycastResult3D World::RaycastVsWorld(const Vec3& start, const Vec3& directi
 
 void World::MarkLightingDirty(const BlockIterator& blockIter)
 {
-	Block& block = *(blockIter.m_chunkBlockBelongsTo->GetBlock(blockIter.m_blockIndex));
-	if (block.IsBlockLightDirty())
-		return;
-
-	block.SetIsBlockLightDirty(true);
-	m_dirtyLightBlocks.push_back(blockIter);
-}
-
-void World::MarkLightingDirtyIfNotOpaque(const BlockIterator& blockIter)
-{
-	Block& block = *(blockIter.m_chunkBlockBelongsTo->GetBlock(blockIter.m_blockIndex));
-	if (!BlockDefintion::IsBlockTypeOpaque(block.m_typeIndex))
-	{
-		MarkLightingDirty(blockIter);
-	}
-}
-
-void World::MarkLightingDirtyIfNotSkyAndNotOpaque(const BlockIterator& blockIter)
-{
-	if (blockIter.m_chunkBlockBelongsTo)
-	{
-		Block& block = *(blockIter.m_chunkBlockBelongsTo->GetBlock(blockIter.m_blockIndex));
-		if (!block.IsBlockSky())
-		{
-			MarkLightingDirtyIfNotOpaque(blockIter);
-		}
-	}
+	blockIter.m_chunkBlockBelongsTo->MarkLightingDirty(blockIter.m_blockIndex);
 }
 
 Chunk* World::GetChunk(IntVec2 chunkCoords) const
@@ -1006,6 +1317,17 @@ Chunk* World::GetChunk(IntVec2 chunkCoords) const
 	return nullptr;
 }
 
+int World::GetZHeightOfHighestOpaqueBlock(const Vec2& worldXY) const
+{
+	int worldX = int(floorf(worldXY.x));
+	int worldY = int(floorf(worldXY.y));
+	Chunk* chunk = GetChunk(IntVec2(worldX >> CHUNK_BITS_X, worldY >> CHUNK_BITS_Y));
+	if (chunk == nullptr)
+		return CHUNK_MAX_Z;
+
+	return chunk->GetZHeightOfHighestOpaqueBlock(worldX & CHUNK_MAX_X, worldY & CHUNK_MAX_Y);
+}
+
 bool ChunkSort::operator()(Chunk* a, Chunk* b)
 {
 	float aDistSquareFromCam = GetDistanceSquared2D(m_camPos, Chunk::GetChunkCenterXYForGlobalChunkCoords(a->GetChunkCoordinates()));
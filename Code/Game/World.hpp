@@ -1,22 +1,48 @@
 #pragma once
 #include <vector>
 #include <map>
+#include <set>
 #include <deque>
 #include <mutex>
 #include "Game/BlockIterator.hpp"
+#include "Game/ChunkHandle.hpp"
+#include "Game/ChunkMesher.hpp"
+#include "Game/ChunkMeshResidency.hpp"
 #include "Engine/Math/MathUtils.hpp"
 #include "Engine/Core/Vertex_PCU.hpp"
 
 class Game;
 class Chunk;
+class ChunkSaveJob;
 class ConstantBuffer;
+class IndexBuffer;
+class VertexBuffer;
 class Shader;
 class Entity;
 class GameCamera;
+class ChunkGenerationJob;
 
 struct GameRaycastResult3D : public RaycastHit3D
 {
 	BlockIterator m_blockImpacted;
+	ChunkHandle m_chunkImpacted;	//validate against this before using m_blockImpacted from a result kept across frames
+};
+
+struct ChunkSlot
+{
+	Chunk* m_chunk = nullptr;
+	uint32_t m_generation = 0;
+};
+
+//entry in the world's mesh rebuild queue, the closest chunk is at the top of the heap
+struct ChunkMeshQueueEntry
+{
+public:
+	float m_distanceSquared = 0.f;
+	ChunkHandle m_chunkHandle;
+
+public:
+	bool operator<(const ChunkMeshQueueEntry& other) const { return m_distanceSquared > other.m_distanceSquared; }
 };
 
 struct ChunkSort
@@ -43,14 +69,27 @@ public:
 	int GetNumberOfChunks() const { return (int)m_activeChunks.size(); }
 	int GetTotalNumberOfVerticesInChunks() const { return m_totalChunkMeshVertices; }
 	float GetWorldTime() const { return m_worldTime; }
+	ChunkMesherType GetChunkMesherType() const { return m_chunkMesherType; }
+	bool IsUsingChunkMeshCache() const { return m_useChunkMeshCache; }
+	bool IsUsingPackedChunkVertices() const { return m_usePackedChunkVertices; }
+	IndexBuffer* GetQuadIndexBuffer() const { return m_quadIndexBuffer; }
+	//grows the quad index buffer when a mesh has more quads than it covers
+	void ReserveQuadIndices(int numQuads);
+	ChunkMeshResidency* GetChunkMeshResidency() const { return m_chunkMeshResidency; }
 	void AddToTotalNumberOfVerticesInChunks(int verts);
+	void QueueSaveJob(ChunkSaveJob* saveJob);
 	void DigBlock();
 	void AddBlock();
 	void MarkLightingDirty(const BlockIterator& blockIter);
-	void MarkLightingDirtyIfNotOpaque(const BlockIterator& blockIter);
-	void MarkLightingDirtyIfNotSkyAndNotOpaque(const BlockIterator& blockIter);
+	//drops both channels of the block to what it gives off itself, the light it spread goes dark and its neighbours spread theirs back in
+	void DarkenBlockLightToSources(const BlockIterator& blockIter);
 	Entity* GetPlayer() const { return m_player; }
 	Chunk* GetChunk(IntVec2 chunkCoords) const;
+	//z of the highest opaque block in the column at a world position, CHUNK_MAX_Z where the chunk is not active so callers stay conservative
+	int GetZHeightOfHighestOpaqueBlock(const Vec2& worldXY) const;
+	Chunk* ResolveChunkHandle(const ChunkHandle& handle) const;
+	void QueueChunkForMeshRebuild(const Chunk& chunk);
+	void QueueChunkForLighting(const Chunk& chunk);
 	GameRaycastResult3D RaycastVsWorld(const Vec3& start, const Vec3& direction, float distance);
 	Game* GetGame() const { return m_game; }
 
@@ -60,6 +99,16 @@ public:
 
 	//threading queues and mutexes
 	std::map<IntVec2, Chunk*> m_chunksQueuedForGeneration;
+	std::deque<ChunkGenerationJob*> m_finishedGenerationJobs;
+	std::deque<ChunkMeshJob*> m_finishedMeshJobs;
+	std::set<IntVec2> m_chunksPendingSave;		//deactivated chunks whose save job has not finished, they are not reinstantiated until it has
+	int m_maxMeshJobsInFlight = 16;
+	float m_chunkMeshBudgetMs = 2.f;		//main thread time per frame for uploading finished meshes and queuing new mesh jobs
+	float m_lightingBudgetMs = 2.f;		//main thread time per frame for propagating dirty light, the rest carries over to the next frame
+	ChunkMesherType m_chunkMesherType = CHUNK_MESHER_PER_BLOCK;
+	bool m_useChunkMeshCache = false;		//chunk meshes are kept in files next to the saves and reloaded for chunks that come back unchanged
+	bool m_usePackedChunkVertices = true;		//chunks upload their packed vertices for the world shader to decode, the default shader needs them decoded to Vertex_PCU
+	int m_numMeshJobsInFlight = 0;
 
 private:
 	Game* m_game = nullptr;
@@ -70,7 +119,14 @@ private:
 
 	//chunk data
 	std::map<IntVec2, Chunk*> m_activeChunks;
-	std::deque<BlockIterator> m_dirtyLightBlocks;
+	std::vector<ChunkSlot> m_chunkSlots;
+	std::vector<uint32_t> m_freeChunkSlots;
+	std::vector<ChunkHandle> m_chunksWithDirtyLighting;		//chunks with dirty light blocks or light changes their mesh has not picked up yet
+	std::vector<ChunkMeshQueueEntry> m_chunkMeshQueue;		//heap of dirty chunks by distance to the camera, at most one entry per chunk
+	Vec2 m_chunkMeshQueueCameraXY = Vec2::ZERO;		//camera position the queue's distances were computed from
+	IndexBuffer* m_quadIndexBuffer = nullptr;		//0,1,2,0,2,3 moved on by four vertices for every quad, shared by all chunk meshes
+	int m_numQuadsInIndexBuffer = 0;
+	ChunkMeshResidency* m_chunkMeshResidency = nullptr;
 	int m_totalChunkMeshVertices = 0;
 	float m_chunkActivationRange = 0.f;
 	float m_chunkDeactivationRange = 0.f;
@@ -107,6 +163,14 @@ private:
 	GameRaycastResult3D m_raycastResult;
 	bool m_freezeRaycastStart = false;
 
+	//dig crack on the block under the raycast, drawn on top of the chunk meshes so digging does not remesh the chunk
+	//packed like the chunk meshes and drawn with the world shader in the local space of the dug block's chunk
+	VertexBuffer* m_digCrackOverlayVBO = nullptr;
+	size_t m_digCrackOverlayVBOSize = 0;
+	int m_numDigCrackOverlayQuads = 0;
+	Vec3 m_digCrackOverlayChunkMins = Vec3::ZERO;
+	Shader* m_digCrackOverlayShader = nullptr;
+
 	//world time
 	float m_worldTime = 0.5f;
 	float m_worldTimeScale = 0.f;
@@ -119,11 +183,16 @@ private:
 	void HandleDebugInput();
 	void AddDebugVertsForChunk(std::vector<Vertex_PCU>& verts) const;
 	void AddDebugVertsForLighting(std::vector<Vertex_PCU>& verts) const;
+	ChunkHandle AllocateChunkHandle(Chunk* chunk);
+	void ReleaseChunkHandle(const ChunkHandle& handle);
+	void RetrieveFinishedJobs();
 	void InstantiateChunk();
 	bool ActivateChunk();
 	void DeactivateChunk();
 	//void SpawnChunk(const IntVec2& chunkCoords);
 	void UpdateChunks(float deltaSeconds);
+	void UpdateChunkMeshes();
+	void ReprioritizeChunkMeshQueue(const Vec2& cameraXY);
 	void UpdateEntities(float deltaSeconds);
 	void UpdateCameras(float deltaSeconds);
 	void RenderChunks() const;
@@ -132,14 +201,17 @@ private:
 	void UpdateDayCycle(float deltaSeconds);
 
 	void ProcessDirtyLighting();
-	uint8_t ComputeIndoorLightInfluence(const BlockIterator& blockIter) const;
-	uint8_t ComputeOutdoorLightInfluence(const BlockIterator& blockIter) const;
-	uint8_t GetHighestOutdoorLightInfluenceAmongNeighbours(const BlockIterator& blockIter) const;
-	uint8_t GetHighestIndoorLightInfluenceAmongNeighbours(const BlockIterator& blockIter) const;
-	void MarkNeighbouringChunksAndBlocksAsDirty(const BlockIterator& blockIter);
+	bool ProcessNextLightUpdate(Chunk& chunk, bool includeIncreases);
+	void ProcessDirtyLightBlock(const BlockIterator& blockIter);
+	void ProcessLightDecrease(const BlockIterator& blockIter, LightChannel channel, uint8_t previousLevel);
+	void ProcessLightIncrease(const BlockIterator& blockIter, LightChannel channel, uint8_t level);
+	void DarkenBlockLight(const BlockIterator& blockIter, LightChannel channel);
+	void OnBlockLightChanged(const BlockIterator& blockIter);
 	void CopyDataToCBOAndBindIt() const;
 
 	void PerformRaycast();
+	void UpdateDigCrackOverlay();
+	void RenderDigCrackOverlay() const;
 
 };
 
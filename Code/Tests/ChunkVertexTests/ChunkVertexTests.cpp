@@ -0,0 +1,296 @@
+#include <cstdio>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "Engine/Core/VertexUtils.hpp"
+#include "Engine/Math/AABB3.hpp"
+#include "Engine/Math/MathUtils.hpp"
+#include "Game/Block.hpp"
+#include "Game/ChunkVertex.hpp"
+
+//checks the packed chunk vertex without a renderer:
+//every field has to survive a round trip at its limits without bleeding into the others,
+//and DecodeToPCU has to reproduce the Vertex_PCU quads the per block mesher built before the vertex was packed
+
+//Block.cpp loads the sprite sheet through the renderer, the tests fill the sprite uvs by hand instead
+class Renderer;
+Renderer* g_theRenderer = nullptr;
+
+constexpr int TEST_SHEET_WIDTH = 64;
+constexpr int TEST_NUM_SPRITES = 4096;
+
+int g_numErrors = 0;
+
+void ReportError(const std::string& message)
+{
+	printf("  %s\n", message.c_str());
+	g_numErrors++;
+}
+
+void CheckEqual(int actual, int expected, const std::string& what)
+{
+	if (actual != expected)
+		ReportError(what + " is " + std::to_string(actual) + ", expected " + std::to_string(expected));
+}
+
+void CheckVertex(const ChunkVertex& vertex, const IntVec3& position, const IntVec3& subBlockOffset, BlockFace face, FaceCorner corner, uint8_t flags, uint16_t spriteIndex, uint8_t outdoorLight, uint8_t indoorLight, const std::string& name)
+{
+	IntVec3 decodedPosition = vertex.GetLocalPosition();
+	IntVec3 decodedOffset = vertex.GetSubBlockOffset();
+	CheckEqual(decodedPosition.x, position.x, name + " position x");
+	CheckEqual(decodedPosition.y, position.y, name + " position y");
+	CheckEqual(decodedPosition.z, position.z, name + " position z");
+	CheckEqual(decodedOffset.x, subBlockOffset.x, name + " sub block x");
+	CheckEqual(decodedOffset.y, subBlockOffset.y, name + " sub block y");
+	CheckEqual(decodedOffset.z, subBlockOffset.z, name + " sub block z");
+	CheckEqual(vertex.GetFace(), face, name + " face");
+	CheckEqual(vertex.GetCorner(), corner, name + " corner");
+	CheckEqual(vertex.GetFlags(), flags, name + " flags");
+	CheckEqual(vertex.GetSpriteIndex(), spriteIndex, name + " sprite");
+	CheckEqual(vertex.GetOutdoorLight(), outdoorLight, name + " outdoor light");
+	CheckEqual(vertex.GetIndoorLight(), indoorLight, name + " indoor light");
+}
+
+int TestRoundTrip()
+{
+	//all fields at zero, all at their max, and each field alone at its max with the rest at zero so a shift or mask that spills shows up
+	const IntVec3 maxPosition(63, 63, 511);
+	const IntVec3 maxOffset(15, 15, 15);
+	const BlockFace maxFace = BLOCK_FACE_NORTH;
+	const FaceCorner maxCorner = FACE_CORNER_TOP_RIGHT;
+	const uint8_t maxFlags = 0x3F;
+	const uint16_t maxSprite = 0xFFF;
+	const uint8_t maxLight = 15;
+	int numErrorsBefore = g_numErrors;
+
+	ChunkVertex zero(IntVec3(0, 0, 0), BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0);
+	CheckVertex(zero, IntVec3(0, 0, 0), IntVec3(0, 0, 0), BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0, "zero");
+	CheckEqual(int(zero.m_positionAndFace | zero.m_spriteAndLight), 0, "zero words");
+
+	ChunkVertex full(maxPosition, maxFace, maxCorner, maxFlags, maxSprite, maxLight, maxLight);
+	full.SetSubBlockOffset(maxOffset);
+	CheckVertex(full, maxPosition, maxOffset, maxFace, maxCorner, maxFlags, maxSprite, maxLight, maxLight, "full");
+
+	const IntVec3 none(0, 0, 0);
+	ChunkVertex x(IntVec3(63, 0, 0), BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0);
+	CheckVertex(x, IntVec3(63, 0, 0), none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0, "x only");
+	ChunkVertex y(IntVec3(0, 63, 0), BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0);
+	CheckVertex(y, IntVec3(0, 63, 0), none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0, "y only");
+	ChunkVertex z(IntVec3(0, 0, 511), BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0);
+	CheckVertex(z, IntVec3(0, 0, 511), none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0, "z only");
+	ChunkVertex face(none, maxFace, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0);
+	CheckVertex(face, none, none, maxFace, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0, "face only");
+	ChunkVertex corner(none, BLOCK_FACE_BOTTOM, maxCorner, 0, 0, 0, 0);
+	CheckVertex(corner, none, none, BLOCK_FACE_BOTTOM, maxCorner, 0, 0, 0, 0, "corner only");
+	ChunkVertex flags(none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, maxFlags, 0, 0, 0);
+	CheckVertex(flags, none, none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, maxFlags, 0, 0, 0, "flags only");
+	ChunkVertex sprite(none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, maxSprite, 0, 0);
+	CheckVertex(sprite, none, none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, maxSprite, 0, 0, "sprite only");
+	ChunkVertex outdoor(none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, maxLight, 0);
+	CheckVertex(outdoor, none, none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, maxLight, 0, "outdoor light only");
+	ChunkVertex indoor(none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, maxLight);
+	CheckVertex(indoor, none, none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, maxLight, "indoor light only");
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		IntVec3 offset(axis == 0 ? 15 : 0, axis == 1 ? 15 : 0, axis == 2 ? 15 : 0);
+		ChunkVertex subBlock(none, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0);
+		subBlock.SetSubBlockOffset(offset);
+		CheckVertex(subBlock, none, offset, BLOCK_FACE_BOTTOM, FACE_CORNER_TOP_LEFT, 0, 0, 0, 0, "sub block " + std::to_string(axis) + " only");
+	}
+
+	//setting the offset again replaces the old one instead of or-ing into it
+	full.SetSubBlockOffset(IntVec3(1, 2, 3));
+	CheckVertex(full, maxPosition, IntVec3(1, 2, 3), maxFace, maxCorner, maxFlags, maxSprite, maxLight, maxLight, "full with new offset");
+	return g_numErrors - numErrorsBefore;
+}
+
+Rgba8 GetBaselineFaceColor(uint8_t outdoorLight, uint8_t indoorLight)
+{
+	//what Chunk::GetFaceColor gave the per block mesher
+	Rgba8 color;
+	color.r = (unsigned char)RangeMap(float(outdoorLight), 0.f, 15.f, 0.f, 255.f);
+	color.g = (unsigned char)RangeMap(float(indoorLight), 0.f, 15.f, 0.f, 255.f);
+	color.b = 0;
+	color.a = 255;
+	return color;
+}
+
+void AddBaselineVertsForFace(std::vector<Vertex_PCU>& verts, std::vector<unsigned int>& indexes, const Vec3& blockMins, BlockFace face, const Rgba8& color, const AABB2& uvs)
+{
+	//the per block mesher's named corners, near is -x, left is +y and top is +z
+	AABB3 bounds(blockMins, blockMins + Vec3(1.f, 1.f, 1.f));
+	Vec3 near_topLeft(bounds.m_mins.x, bounds.m_maxs.y, bounds.m_maxs.z);
+	Vec3 near_bottomLeft(bounds.m_mins.x, bounds.m_maxs.y, bounds.m_mins.z);
+	Vec3 near_bottomRight(bounds.m_mins.x, bounds.m_mins.y, bounds.m_mins.z);
+	Vec3 near_topRight(bounds.m_mins.x, bounds.m_mins.y, bounds.m_maxs.z);
+	Vec3 far_topLeft(bounds.m_maxs.x, bounds.m_maxs.y, bounds.m_maxs.z);
+	Vec3 far_bottomLeft(bounds.m_maxs.x, bounds.m_maxs.y, bounds.m_mins.z);
+	Vec3 far_bottomRight(bounds.m_maxs.x, bounds.m_mins.y, bounds.m_mins.z);
+	Vec3 far_topRight(bounds.m_maxs.x, bounds.m_mins.y, bounds.m_maxs.z);
+
+	switch (face)
+	{
+	case BLOCK_FACE_BOTTOM:	AddVertsForQuad3D(verts, indexes, near_bottomLeft, far_bottomLeft, far_bottomRight, near_bottomRight, color, uvs);	break;
+	case BLOCK_FACE_TOP:	AddVertsForQuad3D(verts, indexes, far_topLeft, near_topLeft, near_topRight, far_topRight, color, uvs);				break;
+	case BLOCK_FACE_WEST:	AddVertsForQuad3D(verts, indexes, near_topLeft, near_bottomLeft, near_bottomRight, near_topRight, color, uvs);		break;
+	case BLOCK_FACE_SOUTH:	AddVertsForQuad3D(verts, indexes, near_topRight, near_bottomRight, far_bottomRight, far_topRight, color, uvs);		break;
+	case BLOCK_FACE_EAST:	AddVertsForQuad3D(verts, indexes, far_topRight, far_bottomRight, far_bottomLeft, far_topLeft, color, uvs);			break;
+	case BLOCK_FACE_NORTH:	AddVertsForQuad3D(verts, indexes, far_topLeft, far_bottomLeft, near_bottomLeft, near_topLeft, color, uvs);			break;
+	default:																																	break;
+	}
+}
+
+bool AreVerticesEqual(const Vertex_PCU& a, const Vertex_PCU& b)
+{
+	const float epsilon = 0.0001f;
+	return fabsf(a.m_position.x - b.m_position.x) < epsilon && fabsf(a.m_position.y - b.m_position.y) < epsilon && fabsf(a.m_position.z - b.m_position.z) < epsilon
+		&& fabsf(a.m_uvTexCoords.x - b.m_uvTexCoords.x) < epsilon && fabsf(a.m_uvTexCoords.y - b.m_uvTexCoords.y) < epsilon
+		&& a.m_color.r == b.m_color.r && a.m_color.g == b.m_color.g && a.m_color.b == b.m_color.b && a.m_color.a == b.m_color.a;
+}
+
+std::string GetVertexAsString(const Vertex_PCU& vertex)
+{
+	char text[256];
+	snprintf(text, sizeof(text), "(%g, %g, %g) rgba(%d, %d, %d, %d) uv(%g, %g)", vertex.m_position.x, vertex.m_position.y, vertex.m_position.z,
+		vertex.m_color.r, vertex.m_color.g, vertex.m_color.b, vertex.m_color.a, vertex.m_uvTexCoords.x, vertex.m_uvTexCoords.y);
+	return text;
+}
+
+int TestDecodeMatchesPerBlockMesher()
+{
+	//a block's face built from FACE_CORNER_AT_MAXS and decoded has to hit the same four vertices as the old quad
+	//the engine's quad helper decides the order it emits them in, so each old vertex is looked up among the decoded ones
+	int numErrorsBefore = g_numErrors;
+	const Vec3 chunkWorldMins(-48.f, 32.f, 0.f);
+	const IntVec3 blockCoords[] = { IntVec3(0, 0, 0), IntVec3(7, 3, 64), IntVec3(15, 15, 127) };
+	const uint16_t spriteIndices[] = { 0, 65, 4095 };
+
+	for (int blockNum = 0; blockNum < 3; blockNum++)
+	{
+		const IntVec3& localCoords = blockCoords[blockNum];
+		uint16_t spriteIndex = spriteIndices[blockNum];
+		uint8_t outdoorLight = uint8_t(blockNum * 7);
+		uint8_t indoorLight = uint8_t(15 - blockNum * 5);
+		for (int faceIndex = 0; faceIndex < NUM_BLOCK_FACES; faceIndex++)
+		{
+			BlockFace face = BlockFace(faceIndex);
+			std::vector<Vertex_PCU> baselineVerts;
+			std::vector<unsigned int> baselineIndexes;
+			AddBaselineVertsForFace(baselineVerts, baselineIndexes, chunkWorldMins + Vec3(localCoords), face, GetBaselineFaceColor(outdoorLight, indoorLight), BlockDefintion::GetSpriteUVs(spriteIndex));
+
+			Vertex_PCU decodedVerts[NUM_FACE_CORNERS];
+			for (int corner = 0; corner < NUM_FACE_CORNERS; corner++)
+			{
+				const bool* atMaxs = FACE_CORNER_AT_MAXS[face][corner];
+				IntVec3 cornerCoords = localCoords + IntVec3(atMaxs[0] ? 1 : 0, atMaxs[1] ? 1 : 0, atMaxs[2] ? 1 : 0);
+				decodedVerts[corner] = ChunkVertex(cornerCoords, face, FaceCorner(corner), 0, spriteIndex, outdoorLight, indoorLight).DecodeToPCU(chunkWorldMins);
+			}
+
+			CheckEqual(int(baselineVerts.size()), NUM_FACE_CORNERS, "baseline face " + std::to_string(faceIndex) + " vertex count");
+			for (int i = 0; i < (int)baselineVerts.size(); i++)
+			{
+				bool found = false;
+				for (int corner = 0; corner < NUM_FACE_CORNERS && !found; corner++)
+				{
+					found = AreVerticesEqual(baselineVerts[i], decodedVerts[corner]);
+				}
+				if (!found)
+					ReportError("block " + std::to_string(blockNum) + " face " + std::to_string(faceIndex) + " has no decoded vertex for " + GetVertexAsString(baselineVerts[i]));
+			}
+		}
+	}
+	return g_numErrors - numErrorsBefore;
+}
+
+int TestDecodeFlags()
+{
+	//the sea surface was drawn with alpha 127 and blue 255, tiled faces take the part of the sprite they cover and cracks sit off the face
+	int numErrorsBefore = g_numErrors;
+	const Vec3 chunkWorldMins(16.f, -16.f, 0.f);
+	const AABB2& uvs = BlockDefintion::GetSpriteUVs(130);
+
+	Vertex_PCU sea = ChunkVertex(IntVec3(3, 4, 5), BLOCK_FACE_TOP, FACE_CORNER_BOTTOM_RIGHT, CHUNK_VERTEX_FLAG_WAVE | CHUNK_VERTEX_FLAG_TRANSLUCENT, 130, 15, 0).DecodeToPCU(chunkWorldMins);
+	CheckEqual(sea.m_color.b, 255, "wave blue");
+	CheckEqual(sea.m_color.a, 127, "translucent alpha");
+	if (!AreVerticesEqual(sea, Vertex_PCU(Vec3(19.f, -12.f, 5.f), Rgba8(255, 0, 255, 127), Vec2(uvs.m_maxs.x, uvs.m_mins.y))))
+		ReportError("sea vertex decodes to " + GetVertexAsString(sea));
+
+	//a tiled face of one whole block takes the same corners as an untiled one, on every face
+	for (int faceIndex = 0; faceIndex < NUM_BLOCK_FACES; faceIndex++)
+	{
+		for (int corner = 0; corner < NUM_FACE_CORNERS; corner++)
+		{
+			const bool* atMaxs = FACE_CORNER_AT_MAXS[faceIndex][corner];
+			IntVec3 cornerCoords(3 + (atMaxs[0] ? 1 : 0), 4 + (atMaxs[1] ? 1 : 0), 5 + (atMaxs[2] ? 1 : 0));
+			Vertex_PCU untiled = ChunkVertex(cornerCoords, BlockFace(faceIndex), FaceCorner(corner), 0, 130, 0, 0).DecodeToPCU(chunkWorldMins);
+			Vertex_PCU tiled = ChunkVertex(cornerCoords, BlockFace(faceIndex), FaceCorner(corner), CHUNK_VERTEX_FLAG_TILED_UVS, 130, 0, 0).DecodeToPCU(chunkWorldMins);
+			if (!AreVerticesEqual(untiled, tiled))
+				ReportError("tiled face " + std::to_string(faceIndex) + " corner " + std::to_string(corner) + " decodes to " + GetVertexAsString(tiled));
+		}
+	}
+
+	//the top corners of a slab's south side are half way up, so they get half way up the sprite
+	ChunkVertex slabTopLeft(IntVec3(3, 4, 5), BLOCK_FACE_SOUTH, FACE_CORNER_TOP_LEFT, CHUNK_VERTEX_FLAG_TILED_UVS, 130, 0, 0);
+	slabTopLeft.SetSubBlockOffset(IntVec3(0, 0, 8));
+	ChunkVertex slabTopRight(IntVec3(4, 4, 5), BLOCK_FACE_SOUTH, FACE_CORNER_TOP_RIGHT, CHUNK_VERTEX_FLAG_TILED_UVS, 130, 0, 0);
+	slabTopRight.SetSubBlockOffset(IntVec3(0, 0, 8));
+	float halfV = 0.5f * (uvs.m_mins.y + uvs.m_maxs.y);
+	if (!AreVerticesEqual(slabTopLeft.DecodeToPCU(chunkWorldMins), Vertex_PCU(Vec3(19.f, -12.f, 5.5f), Rgba8(0, 0, 0, 255), Vec2(uvs.m_mins.x, halfV))))
+		ReportError("slab top left decodes to " + GetVertexAsString(slabTopLeft.DecodeToPCU(chunkWorldMins)));
+	if (!AreVerticesEqual(slabTopRight.DecodeToPCU(chunkWorldMins), Vertex_PCU(Vec3(20.f, -12.f, 5.5f), Rgba8(0, 0, 0, 255), Vec2(uvs.m_maxs.x, halfV))))
+		ReportError("slab top right decodes to " + GetVertexAsString(slabTopRight.DecodeToPCU(chunkWorldMins)));
+
+	ChunkVertex shaped(IntVec3(3, 4, 5), BLOCK_FACE_SOUTH, FACE_CORNER_TOP_LEFT, 0, 130, 0, 0);
+	shaped.SetSubBlockOffset(IntVec3(8, 4, 15));
+	Vertex_PCU shapedVertex = shaped.DecodeToPCU(chunkWorldMins);
+	if (!AreVerticesEqual(shapedVertex, Vertex_PCU(Vec3(19.5f, -11.75f, 5.9375f), Rgba8(0, 0, 0, 255), Vec2(uvs.m_mins.x, uvs.m_maxs.y))))
+		ReportError("sub block vertex decodes to " + GetVertexAsString(shapedVertex));
+
+	const Vec3 faceNormals[NUM_BLOCK_FACES] = { Vec3(0.f, 0.f, -1.f), Vec3(0.f, 0.f, 1.f), Vec3(-1.f, 0.f, 0.f), Vec3(0.f, -1.f, 0.f), Vec3(1.f, 0.f, 0.f), Vec3(0.f, 1.f, 0.f) };
+	for (int faceIndex = 0; faceIndex < NUM_BLOCK_FACES; faceIndex++)
+	{
+		Vertex_PCU plain = ChunkVertex(IntVec3(3, 4, 5), BlockFace(faceIndex), FACE_CORNER_TOP_LEFT, 0, 130, 0, 0).DecodeToPCU(chunkWorldMins);
+		Vertex_PCU crack = ChunkVertex(IntVec3(3, 4, 5), BlockFace(faceIndex), FACE_CORNER_TOP_LEFT, CHUNK_VERTEX_FLAG_CRACK_OVERLAY, 130, 0, 0).DecodeToPCU(chunkWorldMins);
+		plain.m_position += faceNormals[faceIndex] * CHUNK_VERTEX_CRACK_OFFSET;
+		if (!AreVerticesEqual(plain, crack))
+			ReportError("crack on face " + std::to_string(faceIndex) + " decodes to " + GetVertexAsString(crack));
+	}
+	return g_numErrors - numErrorsBefore;
+}
+
+int main()
+{
+	//sprite uvs laid out the way the engine's sprite sheet lays out the block sheet, v runs from the top of the texture down
+	BlockDefintion::s_spriteUVs.clear();
+	float spriteSize = 1.f / float(TEST_SHEET_WIDTH);
+	for (int spriteIndex = 0; spriteIndex < TEST_NUM_SPRITES; spriteIndex++)
+	{
+		float minU = float(spriteIndex % TEST_SHEET_WIDTH) * spriteSize;
+		float maxV = 1.f - float(spriteIndex / TEST_SHEET_WIDTH) * spriteSize;
+		BlockDefintion::s_spriteUVs.push_back(AABB2(Vec2(minU, maxV - spriteSize), Vec2(minU + spriteSize, maxV)));
+	}
+
+	struct Test
+	{
+		const char* m_name;
+		int (*m_function)();
+	};
+	const Test tests[] =
+	{
+		{ "round trip", TestRoundTrip },
+		{ "decode matches per block mesher", TestDecodeMatchesPerBlockMesher },
+		{ "decode flags", TestDecodeFlags },
+	};
+
+	int numFailedTests = 0;
+	for (const Test& test : tests)
+	{
+		int numErrors = test.m_function();
+		printf("%s %s\n", numErrors == 0 ? "PASS" : "FAIL", test.m_name);
+		numFailedTests += numErrors == 0 ? 0 : 1;
+	}
+
+	printf("%d failed\n", numFailedTests);
+	return numFailedTests == 0 ? 0 : 1;
+}
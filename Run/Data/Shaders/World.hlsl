@@ -1,3 +1,6 @@
+//chunk meshes and the dig crack overlay are packed 8 byte chunk vertices, see ChunkVertex.hpp for the layout
+//the engine binds the Vertex_PCU input layout over buffers with an 8 byte stride, so the two packed words arrive as the bits of position x and y
+//color and uv read bytes of the next vertex and are never used, positions are chunk local and the model matrix moves them to the chunk
 struct vs_input_t
 {
 	float3 localPosition : POSITION;
@@ -11,6 +14,9 @@ struct v2p_t
 	float4 color : COLOR;
 	float2 uv : TEXCOORD;
 	float4 worldPosition : WorldPos;
+	float3 localPosition : LocalPos;
+	nointerpolation uint face : FACE;
+	nointerpolation uint isTiled : TILED;
 };
 
 cbuffer CameraConstants : register(b2)
@@ -35,11 +41,42 @@ cbuffer GameConstants : register(b4)
 	float fogEndDistance;
     float fogMaxAlpha;
     float worldTime;
+	float2 blockTileUVSize;
+	float2 spriteUVOrigin;
+	float2 spriteUVStep;
+	float spriteSheetWidth;
+	float padding;
 }
 
 Texture2D diffuseTexture : register(t0);
 SamplerState diffuseSampler : register(s0);
 
+static const uint FLAG_WAVE = 0x01;
+static const uint FLAG_TRANSLUCENT = 0x02;
+static const uint FLAG_TILED_UVS = 0x04;
+static const uint FLAG_CRACK_OVERLAY = 0x08;
+static const float CRACK_OFFSET = 0.01f;
+
+//in BlockFace order
+static const float3 faceNormals[6] =
+{
+	float3(0.f, 0.f, -1.f),
+	float3(0.f, 0.f, 1.f),
+	float3(-1.f, 0.f, 0.f),
+	float3(0.f, -1.f, 0.f),
+	float3(1.f, 0.f, 0.f),
+	float3(0.f, 1.f, 0.f)
+};
+
+//in FaceCorner order
+static const float2 cornerUVs[4] =
+{
+	float2(0.f, 1.f),
+	float2(0.f, 0.f),
+	float2(1.f, 0.f),
+	float2(1.f, 1.f)
+};
+
 float3 DiminishingAdd(float3 a, float3 b)
 {
 	return 1.f - ((1 - a) * (1 - b));
@@ -53,27 +90,87 @@ float GetZOffset(float4 worldPos)
     return (offset - 2.f) / 4.f;	//range mapped -2,2 to -1,0 manually
 }
 
+//the sheet's uvs of sprite 0 and its steps to the next column and row come from the engine's sprite sheet, so this matches however it lays out its sprites
+float2 GetSpriteUVMins(uint spriteIndex)
+{
+	uint sheetWidth = (uint)spriteSheetWidth;
+	float2 spriteCoords = float2(spriteIndex % sheetWidth, spriteIndex / sheetWidth);
+	return spriteUVOrigin + spriteCoords * spriteUVStep;
+}
+
 v2p_t VertexMain(vs_input_t input)
 {
-	float4 localPosition = float4(input.localPosition.x, input.localPosition.y, input.localPosition.z, 1.f);
+	uint positionAndFace = asuint(input.localPosition.x);
+	uint spriteAndLight = asuint(input.localPosition.y);
+	float3 blockPosition = float3(positionAndFace & 0x3F, (positionAndFace >> 6) & 0x3F, (positionAndFace >> 12) & 0x1FF);
+	float3 subBlockOffset = float3((spriteAndLight >> 20) & 0xF, (spriteAndLight >> 24) & 0xF, (spriteAndLight >> 28) & 0xF);
+	uint face = (positionAndFace >> 21) & 0x7;
+	uint corner = (positionAndFace >> 24) & 0x3;
+	uint flags = (positionAndFace >> 26) & 0x3F;
+	uint spriteIndex = spriteAndLight & 0xFFF;
+	float outdoorLight = float((spriteAndLight >> 12) & 0xF) / 15.f;
+	float indoorLight = float((spriteAndLight >> 16) & 0xF) / 15.f;
+
+	float3 position = blockPosition + subBlockOffset / 16.f;
+	if (flags & FLAG_CRACK_OVERLAY)
+		position += faceNormals[face] * CRACK_OFFSET;
+
+	float4 localPosition = float4(position, 1.f);
 	float4 modelSpacePos = mul(modelMatrix, localPosition);
 	
-    float zOffset = GetZOffset(modelSpacePos) * input.color.b;
+	float isWave = (flags & FLAG_WAVE) ? 1.f : 0.f;
+    float zOffset = GetZOffset(modelSpacePos) * isWave;
     modelSpacePos = float4(modelSpacePos.xy, modelSpacePos.z + zOffset, modelSpacePos.w);
 	
+	//tiled faces only carry the sprite's mins, the pixel shader repeats it across the face
+	bool isTiled = (flags & FLAG_TILED_UVS) != 0;
+	float2 uv = GetSpriteUVMins(spriteIndex);
+	if (!isTiled)
+		uv += cornerUVs[corner] * blockTileUVSize;
+	
 	float4 viewSpacePos = mul(viewMatrix, modelSpacePos);
 	float4 ndcPos = mul(projectionMatrix, viewSpacePos);
 	v2p_t v2p;
 	v2p.position = ndcPos;
 	v2p.worldPosition = modelSpacePos;
-	v2p.color = input.color;
-	v2p.uv = input.uv;
+	v2p.color = float4(outdoorLight, indoorLight, isWave, (flags & FLAG_TRANSLUCENT) ? 127.f / 255.f : 1.f);
+	v2p.uv = uv;
+	v2p.localPosition = position;
+	v2p.face = face;
+	v2p.isTiled = isTiled ? 1 : 0;
 	return v2p;
 }
 
+//merged faces span several blocks and shaped block faces only part of one, their vertices only carry the mins of the block's sprite and the texture is repeated once per block here
+//u runs left to right and v bottom to top as seen from outside the face, matching the corners used by the chunk mesher and ChunkVertex::DecodeToPCU
+//the chunk local position is used so the waves can not move the texture
+float2 GetTiledBlockUV(float2 tileMins, float3 localPos, uint face)
+{
+	float2 faceUV;
+	if (face == 0)
+		faceUV = float2(-localPos.y, -localPos.x);
+	else if (face == 1)
+		faceUV = float2(-localPos.y, localPos.x);
+	else if (face == 2)
+		faceUV = float2(-localPos.y, localPos.z);
+	else if (face == 3)
+		faceUV = float2(localPos.x, localPos.z);
+	else if (face == 4)
+		faceUV = float2(localPos.y, localPos.z);
+	else
+		faceUV = float2(-localPos.x, localPos.z);
+	
+	//stay just inside the sprite so point sampling never picks up its neighbour
+	return tileMins + min(frac(faceUV), 0.999f) * blockTileUVSize;
+}
+
 float4 PixelMain(v2p_t input) : SV_Target0
 {
-	float4 output = float4(diffuseTexture.Sample(diffuseSampler, input.uv));
+	float2 uv = input.uv;
+	if (input.isTiled != 0)
+		uv = GetTiledBlockUV(input.uv, input.localPosition, input.face);
+	
+	float4 output = float4(diffuseTexture.Sample(diffuseSampler, uv));
 	if (output.a < 0.01)
 	{
 		discard;